@@ -0,0 +1,239 @@
+#pragma once
+
+#include "Futex.h"
+
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <cstdint>
+
+// A read/write mutex whose waiters do not have to be threads.
+//
+// Waiters are queued in FIFO order. When the lock is released it is handed over
+// to the waiter(s) at the front of the queue (one writer, or all consecutive
+// readers) before they are woken up, so that a woken waiter owns the lock
+// without having to try again.
+//
+// A waiter is woken up by calling its m_wake function, which for a blocked
+// thread (rdlock(), wrlock()) is a futex wake and for a coroutine (see
+// AsyncAccess.h) posts the coroutine to an executor.
+//
+// The interface is that of AIReadWriteMutex, so it can be used with
+// policy::ReadWrite; it also has lock() and unlock() for policy::Primitive.
+// Converting a read lock into a write lock (rd2wrlock) has priority over
+// queued waiters.
+class AIAsyncReadWriteMutex
+{
+  public:
+    struct Waiter
+    {
+      enum Kind { reader, writer };
+
+      Kind const m_kind;
+      void (*const m_wake)(Waiter*);            // Called, without holding any lock, once this waiter owns the lock.
+      Waiter* m_next = nullptr;
+
+      Waiter(Kind kind, void (*wake)(Waiter*)) : m_kind(kind), m_wake(wake) { }
+    };
+
+  private:
+    // A thread that is blocked in rdlock(), wrlock() or rd2wrlock().
+    struct BlockedThread : Waiter
+    {
+      std::atomic<uint32_t> m_granted{0};
+
+      BlockedThread(Kind kind) : Waiter(kind, &wake) { }
+
+      static void wake(Waiter* waiter)
+      {
+        std::atomic<uint32_t>& granted = static_cast<BlockedThread*>(waiter)->m_granted;
+        granted.store(1, std::memory_order_release);
+        // The waiter might already have returned; a futex wake on a stale address is harmless.
+        threadsafe::futex::wake(granted, 1);
+      }
+
+      void wait()
+      {
+        while (m_granted.load(std::memory_order_acquire) == 0)
+          threadsafe::futex::wait(m_granted, 0);
+      }
+    };
+
+    static constexpr int write_locked = -1;
+
+    std::mutex m_mutex;
+    int m_readers = 0;                          // The number of read locks, or write_locked.
+    Waiter* m_head = nullptr;                   // The queue of waiters.
+    Waiter* m_tail = nullptr;
+    Waiter* m_converter = nullptr;              // A reader that waits for the other readers to leave (rd2wrlock).
+
+    void enqueue(Waiter* waiter)
+    {
+      waiter->m_next = nullptr;
+      if (m_tail)
+        m_tail->m_next = waiter;
+      else
+        m_head = waiter;
+      m_tail = waiter;
+    }
+
+    // Hand the lock over to as many waiters as possible. Must be called with m_mutex locked.
+    // Returns the list of waiters that now own the lock and must be woken up.
+    Waiter* grant()
+    {
+      if (m_converter)
+      {
+        if (m_readers != 1)
+          return nullptr;
+        m_readers = write_locked;
+        Waiter* converter = m_converter;
+        m_converter = nullptr;
+        converter->m_next = nullptr;
+        return converter;
+      }
+      Waiter* granted = nullptr;
+      Waiter** last = &granted;
+      while (m_head)
+      {
+        if (m_head->m_kind == Waiter::writer ? m_readers != 0 : m_readers == write_locked)
+          break;
+        Waiter* waiter = m_head;
+        m_head = waiter->m_next;
+        waiter->m_next = nullptr;
+        *last = waiter;
+        last = &waiter->m_next;
+        if (waiter->m_kind == Waiter::writer)
+        {
+          m_readers = write_locked;
+          break;
+        }
+        ++m_readers;
+      }
+      if (!m_head)
+        m_tail = nullptr;
+      return granted;
+    }
+
+    static void wake_up(Waiter* granted)
+    {
+      while (granted)
+      {
+        // Read m_next first: the waiter can be gone as soon as it is woken up.
+        Waiter* next = granted->m_next;
+        granted->m_wake(granted);
+        granted = next;
+      }
+    }
+
+    // New readers don't overtake queued waiters, so that writers don't starve.
+    bool can_read() const { return m_readers != write_locked && !m_head && !m_converter; }
+    bool can_write() const { return m_readers == 0 && !m_head; }
+
+  public:
+    // Try to obtain the lock for waiter; returns true if that succeeded immediately.
+    // Otherwise the waiter is queued and waiter->m_wake will be called once it owns the lock.
+    bool async_lock(Waiter* waiter)
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (waiter->m_kind == Waiter::reader ? can_read() : can_write())
+      {
+        m_readers = waiter->m_kind == Waiter::reader ? m_readers + 1 : write_locked;
+        return true;
+      }
+      enqueue(waiter);
+      return false;
+    }
+
+    bool try_rdlock()
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (!can_read())
+        return false;
+      ++m_readers;
+      return true;
+    }
+
+    bool try_wrlock()
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (!can_write())
+        return false;
+      m_readers = write_locked;
+      return true;
+    }
+
+    void rdlock()
+    {
+      BlockedThread waiter(Waiter::reader);
+      if (!async_lock(&waiter))
+        waiter.wait();
+    }
+
+    void wrlock()
+    {
+      BlockedThread waiter(Waiter::writer);
+      if (!async_lock(&waiter))
+        waiter.wait();
+    }
+
+    void rdunlock()
+    {
+      Waiter* granted;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        --m_readers;
+        granted = grant();
+      }
+      wake_up(granted);
+    }
+
+    void wrunlock()
+    {
+      Waiter* granted;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_readers = 0;
+        granted = grant();
+      }
+      wake_up(granted);
+    }
+
+    // Convert a read lock into a write lock.
+    // Throws when another thread is already converting; the caller must then release
+    // its read lock, call rd2wryield() and try again.
+    void rd2wrlock()
+    {
+      BlockedThread waiter(Waiter::writer);
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (m_converter)
+          throw std::exception();
+        if (m_readers == 1)
+        {
+          m_readers = write_locked;
+          return;
+        }
+        m_converter = &waiter;
+      }
+      waiter.wait();
+    }
+
+    void wr2rdlock()
+    {
+      Waiter* granted;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_readers = 1;
+        granted = grant();
+      }
+      wake_up(granted);
+    }
+
+    void rd2wryield() { std::this_thread::yield(); }
+
+    // For policy::Primitive.
+    void lock() { wrlock(); }
+    bool try_lock() { return try_wrlock(); }
+    void unlock() { wrunlock(); }
+};
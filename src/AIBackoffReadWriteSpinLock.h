@@ -0,0 +1,364 @@
+#pragma once
+
+#include "Backoff.h"
+#include "Futex.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+#include <cassert>
+
+namespace threadsafe::fairness {
+
+// Who gets the lock when both readers and writers are waiting.
+
+// A writer only gets the lock when there are no readers at all.
+// Highest read throughput; writers can starve behind a continuous stream of readers.
+struct ReaderPreferring { };
+
+// Once a writer is waiting no new readers are let in.
+// Readers can starve behind a continuous stream of writers.
+struct WriterPreferring { };
+
+// Like WriterPreferring, but when a writer releases the lock all readers that
+// arrived while it was waiting or holding the lock get in before the next writer.
+// Read and write phases alternate, so neither side can starve (Brandenburg and
+// Anderson's phase-fair reader-writer locks).
+struct PhaseFair { };
+
+} // namespace threadsafe::fairness
+
+// A read/write spin lock with the interface of AIReadWriteSpinLock whose
+// waiting behavior is selected at compile time with a backoff strategy
+// (see Backoff.h):
+//
+//   AIBackoffReadWriteSpinLock<threadsafe::backoff::Spin>            - spin with pause only.
+//   AIBackoffReadWriteSpinLock<threadsafe::backoff::Exponential<>>   - exponential backoff.
+//   AIBackoffReadWriteSpinLock<threadsafe::backoff::SpinThenPark<>>  - exponential backoff, then futex wait (default).
+//   AIBackoffReadWriteSpinLock<threadsafe::backoff::Park>            - futex wait right away; a blocking mutex.
+//
+// and whose fairness is selected with the second template parameter, one of
+// the types in threadsafe::fairness (default WriterPreferring).
+//
+// The state is a single 32-bit word, so that it can also serve as futex.
+// A thread that parks sets the parked bit first; any thread that changes the
+// state in a way that might let a parked thread continue clears that bit
+// and wakes up all parked threads. Strategies that never park never cause
+// a system call.
+//
+// try_rdlock() and try_wrlock() never wait; rdlock_until() and wrlock_until()
+// give up when a deadline passed (see TryAccess.h). A writer that gives up
+// while waiting for the readers to leave lets in the readers that queued up
+// behind it.
+template<typename BACKOFF = threadsafe::backoff::SpinThenPark<>, typename FAIRNESS = threadsafe::fairness::WriterPreferring>
+class AIBackoffReadWriteSpinLock
+{
+  private:
+    static constexpr bool reader_preferring = std::is_same_v<FAIRNESS, threadsafe::fairness::ReaderPreferring>;
+    static constexpr bool phase_fair = std::is_same_v<FAIRNESS, threadsafe::fairness::PhaseFair>;
+
+    static constexpr uint32_t reader_mask = 0x00003fff;         // Number of readers that hold the lock.
+    static constexpr uint32_t one_reader = 0x00000001;
+    static constexpr uint32_t waiting_mask = 0x0fffc000;        // PhaseFair: number of readers waiting for the next read phase.
+    static constexpr uint32_t one_waiting = 0x00004000;
+    static constexpr int waiting_shift = 14;
+    static constexpr uint32_t phase = 0x10000000;               // PhaseFair: toggled whenever waiting readers are let in.
+    static constexpr uint32_t parked = 0x20000000;              // At least one thread is blocked in futex wait.
+    static constexpr uint32_t converting = 0x40000000;          // A reader is converting its read lock into a write lock.
+    static constexpr uint32_t writer = 0x80000000;              // Write locked; or, unless ReaderPreferring, a writer is waiting for the readers to leave.
+
+    std::atomic<uint32_t> m_state{0};
+
+    // Call try_lock(state) with the current state until it returns true.
+    // try_lock must return false without side effects when the lock can not be obtained.
+    template<typename TRY_LOCK>
+    void wait(TRY_LOCK try_lock)
+    {
+      BACKOFF backoff;
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!try_lock(state))
+      {
+        if (!backoff.pause())
+        {
+          park(state);
+          backoff.reset();
+        }
+        state = m_state.load(std::memory_order_relaxed);
+      }
+    }
+
+    // Like wait(), but give up when deadline passed. Returns true if try_lock succeeded.
+    template<typename TRY_LOCK>
+    bool wait_until(TRY_LOCK try_lock, std::chrono::steady_clock::time_point deadline)
+    {
+      BACKOFF backoff;
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!try_lock(state))
+      {
+        if (std::chrono::steady_clock::now() >= deadline)
+          return false;
+        if (!backoff.pause())
+        {
+          timespec const monotonic_deadline = threadsafe::futex::monotonic_deadline(deadline);
+          park(state, &monotonic_deadline);
+          backoff.reset();
+        }
+        state = m_state.load(std::memory_order_relaxed);
+      }
+      return true;
+    }
+
+    void park(uint32_t state, timespec const* deadline = nullptr)
+    {
+      if (!(state & parked) && !m_state.compare_exchange_strong(state, state | parked, std::memory_order_relaxed))
+        return;         // The state changed; try again.
+      threadsafe::futex::wait(m_state, state | parked, threadsafe::futex::any, deadline);
+    }
+
+    void wake_if_parked(uint32_t previous_state)
+    {
+      if ((previous_state & parked))
+        threadsafe::futex::wake(m_state);
+    }
+
+    // Release the write lock, leaving readers read locks; returns the previous state.
+    // In PhaseFair mode all waiting readers are let in as well.
+    uint32_t release_write_lock(uint32_t readers)
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      uint32_t new_state;
+      do
+      {
+        // While write locked there are no readers and nobody is converting.
+        assert((state & writer) && !(state & (reader_mask | converting)));
+        new_state = (state & phase) | readers;
+        if (phase_fair && (state & waiting_mask))
+        {
+          assert(readers + ((state & waiting_mask) >> waiting_shift) <= reader_mask);
+          new_state = ((state & phase) ^ phase) + readers + ((state & waiting_mask) >> waiting_shift);
+        }
+      }
+      while (!m_state.compare_exchange_weak(state, new_state, std::memory_order_release, std::memory_order_relaxed));
+      return state;
+    }
+
+    // Give up the writer bit, claimed by timed_wrlock, while readers still hold the lock.
+    void abandon_write_lock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      uint32_t new_state;
+      do
+      {
+        assert((state & writer) && !(state & converting));
+        new_state = state & ~(writer | parked);
+        // Let in the readers that queued up behind us.
+        if (phase_fair && (state & waiting_mask))
+          new_state = ((new_state & ~waiting_mask) ^ phase) + ((state & waiting_mask) >> waiting_shift);
+      }
+      while (!m_state.compare_exchange_weak(state, new_state, std::memory_order_relaxed));
+      wake_if_parked(state);
+    }
+
+    bool timed_rdlock(std::chrono::steady_clock::time_point deadline)
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        if (!(state & (writer | converting)))
+        {
+          if (m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+          continue;
+        }
+        if constexpr (phase_fair)
+        {
+          if (!m_state.compare_exchange_weak(state, state + one_waiting, std::memory_order_relaxed))
+            continue;
+          uint32_t const my_phase = state & phase;
+          if (!wait_until([my_phase](uint32_t& state){ return (state & phase) != my_phase; }, deadline))
+          {
+            // Leave the next read phase again, unless it started meanwhile.
+            state = m_state.load(std::memory_order_relaxed);
+            while ((state & phase) == my_phase)
+              if (m_state.compare_exchange_weak(state, state - one_waiting, std::memory_order_relaxed))
+                return false;
+          }
+          std::atomic_thread_fence(std::memory_order_acquire);
+          return true;
+        }
+        else
+          return wait_until([this](uint32_t& state){
+            return !(state & (writer | converting)) &&
+              m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed);
+          }, deadline);
+      }
+    }
+
+    bool timed_wrlock(std::chrono::steady_clock::time_point deadline)
+    {
+      if constexpr (reader_preferring)
+        return wait_until([this](uint32_t& state){
+          return !(state & (writer | converting | reader_mask)) &&
+            m_state.compare_exchange_weak(state, state | writer, std::memory_order_acquire, std::memory_order_relaxed);
+        }, deadline);
+      if (!wait_until([this](uint32_t& state){
+            return !(state & (writer | converting)) &&
+              m_state.compare_exchange_weak(state, state | writer, std::memory_order_relaxed);
+          }, deadline))
+        return false;
+      if (!wait_until([](uint32_t& state){ return (state & reader_mask) == 0; }, deadline))
+      {
+        abandon_write_lock();
+        return false;
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return true;
+    }
+
+  public:
+    void rdlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        if (!(state & (writer | converting)))
+        {
+          assert((state & reader_mask) != reader_mask);
+          if (m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+          continue;
+        }
+        if constexpr (phase_fair)
+        {
+          // Join the next read phase: the writer that releases the lock turns us into a reader.
+          assert((state & waiting_mask) != waiting_mask);
+          if (!m_state.compare_exchange_weak(state, state + one_waiting, std::memory_order_relaxed))
+            continue;
+          uint32_t const my_phase = state & phase;
+          wait([my_phase](uint32_t& state){ return (state & phase) != my_phase; });
+          std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        else
+          wait([this](uint32_t& state){
+            return !(state & (writer | converting)) &&
+              m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed);
+          });
+        return;
+      }
+    }
+
+    bool try_rdlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!(state & (writer | converting)))
+      {
+        assert((state & reader_mask) != reader_mask);
+        if (m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed))
+          return true;
+      }
+      return false;
+    }
+
+    // Like rdlock(), but give up when deadline passed. Returns true if the lock was obtained.
+    template<typename CLOCK, typename DURATION>
+    bool rdlock_until(std::chrono::time_point<CLOCK, DURATION> const& deadline)
+    {
+      return timed_rdlock(threadsafe::futex::steady_deadline(deadline));
+    }
+
+    void rdunlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      uint32_t new_state;
+      do
+      {
+        assert((state & reader_mask) > 0);
+        new_state = state - one_reader;
+        // A writer might be waiting for the last reader, or a converting reader for the last but one.
+        uint32_t readers_left = new_state & reader_mask;
+        if (readers_left == ((new_state & converting) ? 1 : 0))
+          new_state &= ~parked;
+      }
+      while (!m_state.compare_exchange_weak(state, new_state, std::memory_order_release, std::memory_order_relaxed));
+      if (!(new_state & parked))
+        wake_if_parked(state);
+    }
+
+    void wrlock()
+    {
+      if constexpr (reader_preferring)
+      {
+        // Only take the lock when there are no readers.
+        wait([this](uint32_t& state){
+          return !(state & (writer | converting | reader_mask)) &&
+            m_state.compare_exchange_weak(state, state | writer, std::memory_order_acquire, std::memory_order_relaxed);
+        });
+        return;
+      }
+      // Claim the writer bit, then wait for the readers to leave.
+      wait([this](uint32_t& state){
+        return !(state & (writer | converting)) &&
+          m_state.compare_exchange_weak(state, state | writer, std::memory_order_relaxed);
+      });
+      wait([](uint32_t& state){ return (state & reader_mask) == 0; });
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    bool try_wrlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!(state & (writer | converting | reader_mask)))
+        if (m_state.compare_exchange_weak(state, state | writer, std::memory_order_acquire, std::memory_order_relaxed))
+          return true;
+      return false;
+    }
+
+    // Like wrlock(), but give up when deadline passed. Returns true if the lock was obtained.
+    template<typename CLOCK, typename DURATION>
+    bool wrlock_until(std::chrono::time_point<CLOCK, DURATION> const& deadline)
+    {
+      return timed_wrlock(threadsafe::futex::steady_deadline(deadline));
+    }
+
+    void wrunlock()
+    {
+      wake_if_parked(release_write_lock(0));
+    }
+
+    // Convert a read lock into a write lock.
+    // Throws when another thread is converting, or a writer is waiting for us
+    // to leave; the caller must then release its read lock, call rd2wryield()
+    // and try again.
+    void rd2wrlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      do
+      {
+        assert((state & reader_mask) > 0);
+        if ((state & (writer | converting)))
+          throw std::exception();
+      }
+      while (!m_state.compare_exchange_weak(state, state | converting, std::memory_order_relaxed));
+      wait([this](uint32_t& state){
+        return (state & reader_mask) == one_reader &&
+          m_state.compare_exchange_weak(state, (state & ~(converting | reader_mask)) | writer, std::memory_order_acquire, std::memory_order_relaxed);
+      });
+    }
+
+    void wr2rdlock()
+    {
+      wake_if_parked(release_write_lock(one_reader));
+    }
+
+    // Wait until the thread that is converting its read lock has succeeded.
+    void rd2wryield()
+    {
+      wait([](uint32_t& state){ return !(state & converting); });
+    }
+};
+
+// A blocking read/write mutex with selectable fairness.
+template<typename FAIRNESS = threadsafe::fairness::WriterPreferring>
+using AIParkingReadWriteMutex = AIBackoffReadWriteSpinLock<threadsafe::backoff::Park, FAIRNESS>;
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "CpuTopology.h"
+#include "ThreadSlot.h"
+#include "Backoff.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <exception>
+#include <cstdint>
+
+// A topology aware (cohort) read/write spin lock with the interface of AIReadWriteSpinLock.
+//
+// Threads are grouped by the cluster of CPUs that they run on (see CpuTopology.h).
+// A writer first obtains the lock of its own cluster and then the global lock.
+// When it releases the write lock while another writer of the same cluster is
+// waiting, it passes the global lock on to that writer by releasing only the
+// cluster lock; the lock and the data that it protects then stay in the cache
+// that those CPUs share. After max_local_handoffs consecutive local handoffs the
+// global lock is released anyway, so that other clusters, and readers, get their turn.
+//
+// Readers increment a counter of their own cluster, so that readers on different
+// clusters don't write to the same cache line. Writers have precedence over new
+// readers, also while the lock is passed on within a cluster.
+//
+// The cluster of a thread is determined the first time it uses the lock; threads
+// should be pinned to a CPU, or at least a cluster, to get the full benefit.
+// On a machine with a single cluster this is a writer-preferring spin lock.
+template<int max_local_handoffs = 64>
+class AICohortReadWriteLock
+{
+  private:
+    struct Cluster
+    {
+      alignas(threadsafe::cache_line_size) std::atomic<uint32_t> m_readers{0};
+      alignas(threadsafe::cache_line_size) std::atomic<bool> m_locked{false};    // The cluster lock.
+      std::atomic<uint32_t> m_waiting{0};       // The number of writers of this cluster that wait for m_locked.
+      bool m_passed = false;                    // The global lock was passed on to the next writer of this cluster.
+      int m_handoffs = 0;                       // The number of consecutive local handoffs.
+    };
+
+    static constexpr int converted = -1;
+
+    alignas(threadsafe::cache_line_size) std::atomic<bool> m_global{false};   // Set while a cluster owns the write lock.
+    int m_owner;                                // The cluster of the write lock holder, or converted.
+    int const m_number_of_clusters;
+    std::unique_ptr<Cluster[]> m_clusters;
+
+    template<typename CONDITION>
+    static void spin_until(CONDITION condition)
+    {
+      threadsafe::backoff::SpinThenPark<> backoff;
+      while (!condition())
+        if (!backoff.pause())
+        {
+          std::this_thread::yield();
+          backoff.reset();
+        }
+    }
+
+    // Wait until, apart from own_reads on cluster own, no cluster has readers.
+    void wait_for_readers(int own = 0, uint32_t own_reads = 0)
+    {
+      for (int cluster = 0; cluster < m_number_of_clusters; ++cluster)
+      {
+        uint32_t const reads = cluster == own ? own_reads : 0;
+        spin_until([&]{ return m_clusters[cluster].m_readers.load(std::memory_order_seq_cst) == reads; });
+      }
+    }
+
+    void release_write_lock(bool allow_handoff)
+    {
+      if (m_owner == converted)
+      {
+        m_global.store(false, std::memory_order_release);
+        return;
+      }
+      Cluster& cluster = m_clusters[m_owner];
+      if (allow_handoff && cluster.m_waiting.load(std::memory_order_relaxed) > 0 && cluster.m_handoffs < max_local_handoffs)
+      {
+        ++cluster.m_handoffs;
+        cluster.m_passed = true;
+      }
+      else
+        m_global.store(false, std::memory_order_release);
+      cluster.m_locked.store(false, std::memory_order_release);
+    }
+
+  public:
+    AICohortReadWriteLock() :
+      m_number_of_clusters(threadsafe::CpuTopology::instance().number_of_clusters()),
+      m_clusters(std::make_unique<Cluster[]>(m_number_of_clusters)) { }
+
+    void rdlock()
+    {
+      Cluster& cluster = m_clusters[threadsafe::CpuTopology::current_cluster()];
+      for (;;)
+      {
+        cluster.m_readers.fetch_add(1, std::memory_order_seq_cst);
+        if (!m_global.load(std::memory_order_seq_cst))
+          return;
+        cluster.m_readers.fetch_sub(1, std::memory_order_relaxed);
+        spin_until([this]{ return !m_global.load(std::memory_order_relaxed); });
+      }
+    }
+
+    void rdunlock()
+    {
+      m_clusters[threadsafe::CpuTopology::current_cluster()].m_readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void wrlock()
+    {
+      int const own = threadsafe::CpuTopology::current_cluster();
+      Cluster& cluster = m_clusters[own];
+      cluster.m_waiting.fetch_add(1, std::memory_order_relaxed);
+      spin_until([&]{ return !cluster.m_locked.load(std::memory_order_relaxed) && !cluster.m_locked.exchange(true, std::memory_order_acquire); });
+      cluster.m_waiting.fetch_sub(1, std::memory_order_relaxed);
+      // When the global lock was passed on to us, readers were kept out all along.
+      if (cluster.m_passed)
+        cluster.m_passed = false;
+      else
+      {
+        spin_until([this]{ return !m_global.load(std::memory_order_relaxed) && !m_global.exchange(true, std::memory_order_seq_cst); });
+        cluster.m_handoffs = 0;
+        wait_for_readers();
+      }
+      m_owner = own;
+    }
+
+    void wrunlock()
+    {
+      release_write_lock(true);
+    }
+
+    // Convert a read lock into a write lock.
+    // Throws when another thread has, or is waiting for, the write lock; the caller
+    // must then release its read lock, call rd2wryield() and try again.
+    void rd2wrlock()
+    {
+      if (m_global.load(std::memory_order_relaxed) || m_global.exchange(true, std::memory_order_seq_cst))
+        throw std::exception();
+      int const own = threadsafe::CpuTopology::current_cluster();
+      wait_for_readers(own, 1);
+      m_clusters[own].m_readers.fetch_sub(1, std::memory_order_relaxed);
+      m_owner = converted;
+    }
+
+    void wr2rdlock()
+    {
+      m_clusters[threadsafe::CpuTopology::current_cluster()].m_readers.fetch_add(1, std::memory_order_relaxed);
+      // Don't pass the lock on; the next writer would not wait for our read lock.
+      release_write_lock(false);
+    }
+
+    // Wait until the writer or converting reader has finished.
+    void rd2wryield()
+    {
+      spin_until([this]{ return !m_global.load(std::memory_order_relaxed); });
+    }
+};
@@ -0,0 +1,195 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "AICohortReadWriteLock.h"
+#include "AIBackoffReadWriteSpinLock.h"
+#include "CpuTopology.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// AICohortReadWriteLock: first a correctness run with readers, writers and
+// converting readers; then a write-heavy benchmark with the threads pinned to
+// chosen CPUs, compared with AIBackoffReadWriteSpinLock. Besides the throughput
+// it prints how often the write lock moved to a thread on another cluster of CPUs.
+//
+// On a machine with one cluster both placements are the same and every handoff is local.
+
+using namespace threadsafe;
+
+int constexpr ops = 200000;
+
+struct Shared
+{
+  long x = 0;
+  long y = 0;                   // Always equal to -x outside the write lock.
+  int last_cluster = -1;        // The cluster of the last writer.
+  long cluster_switches = 0;
+};
+
+using cohort_lock_type = AICohortReadWriteLock<>;
+using unlocked_Shared_cohort_t = Unlocked<Shared, policy::ReadWrite<cohort_lock_type>>;
+using unlocked_Shared_spin_t = Unlocked<Shared, policy::ReadWrite<AIBackoffReadWriteSpinLock<>>>;
+
+void test_correctness()
+{
+  unlocked_Shared_cohort_t shared;
+  int const threads = 8;
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops / 10; ++i)
+      {
+        if ((i + t) % 7 == 0)
+        {
+          unlocked_Shared_cohort_t::wat shared_w(shared);
+          ++shared_w->x;
+          --shared_w->y;
+        }
+        else if ((i + t) % 11 == 0)
+        {
+          // Convert a read lock into a write lock.
+          for (;;)
+          {
+            try
+            {
+              unlocked_Shared_cohort_t::rat shared_r(shared);
+              assert(shared_r->x == -shared_r->y);
+              unlocked_Shared_cohort_t::wat shared_w(shared_r);
+              ++shared_w->x;
+              --shared_w->y;
+              break;
+            }
+            catch (std::exception const&)
+            {
+              shared.rd2wryield();
+            }
+          }
+        }
+        else
+        {
+          unlocked_Shared_cohort_t::crat shared_r(shared);
+          assert(shared_r->x == -shared_r->y);
+        }
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  long expected = 0;
+  for (int t = 0; t < threads; ++t)
+    for (int i = 0; i < ops / 10; ++i)
+      if ((i + t) % 7 == 0 || (i + t) % 11 == 0)
+        ++expected;
+  unlocked_Shared_cohort_t::crat shared_r(shared);
+  std::cout << "Readers, writers and conversions: " << (shared_r->x == expected && shared_r->y == -expected ? "Success!" : "FAILED!") << std::endl;
+  assert(shared_r->x == expected);
+}
+
+struct Result
+{
+  double mops;
+  double switch_percentage;
+};
+
+// Every thread is pinned to the corresponding CPU in cpus; nine out of ten operations are writes.
+template<typename UNLOCKED>
+Result run(std::vector<int> const& cpus)
+{
+  UNLOCKED shared;
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> thread_pool;
+  int const threads = cpus.size();
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      CpuTopology::pin_current_thread(cpus[t]);
+      int const cluster = CpuTopology::instance().cluster_of(cpus[t]);
+      ++ready;
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      for (int i = 0; i < ops; ++i)
+      {
+        if (i % 10 != 0)
+        {
+          typename UNLOCKED::wat shared_w(shared);
+          ++shared_w->x;
+          --shared_w->y;
+          if (shared_w->last_cluster != cluster)
+          {
+            shared_w->last_cluster = cluster;
+            ++shared_w->cluster_switches;
+          }
+        }
+        else
+        {
+          typename UNLOCKED::crat shared_r(shared);
+          assert(shared_r->x == -shared_r->y);
+        }
+      }
+    });
+  while (ready != threads)
+    std::this_thread::yield();
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : thread_pool)
+    thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  typename UNLOCKED::crat shared_r(shared);
+  return { static_cast<double>(threads) * ops / seconds / 1e6, 100.0 * shared_r->cluster_switches / shared_r->x };
+}
+
+void benchmark(std::string const& placement, std::vector<int> const& cpus)
+{
+  std::cout << placement << " (CPUs";
+  for (int cpu : cpus)
+    std::cout << ' ' << cpu;
+  std::cout << "):" << std::endl;
+  auto print = [](char const* name, Result result){
+    std::cout << "  " << std::setw(28) << std::left << name << std::right << std::fixed << std::setprecision(2) <<
+      std::setw(12) << result.mops << std::setw(12) << result.switch_percentage << std::endl;
+  };
+  print("AIBackoffReadWriteSpinLock", run<unlocked_Shared_spin_t>(cpus));
+  print("AICohortReadWriteLock", run<unlocked_Shared_cohort_t>(cpus));
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  CpuTopology const& topology = CpuTopology::instance();
+  std::cout << topology.number_of_cpus() << " CPUs in " << topology.number_of_clusters() << " cluster(s)." << std::endl;
+
+  test_correctness();
+
+  // Use at most four CPUs of at most two clusters, and at least two threads.
+  int const clusters = std::min(2, topology.number_of_clusters());
+  int per_cluster = 4 / clusters;
+  for (int cluster = 0; cluster < clusters; ++cluster)
+    per_cluster = std::min(per_cluster, static_cast<int>(topology.cpus_of(cluster).size()));
+  std::vector<int> packed;      // All threads on the CPUs of the first cluster (where possible).
+  std::vector<int> spread;      // The threads alternate between the clusters.
+  for (int i = 0; i < per_cluster; ++i)
+    for (int cluster = 0; cluster < clusters; ++cluster)
+      spread.push_back(topology.cpus_of(cluster)[i]);
+  std::vector<int> const& first = topology.cpus_of(0);
+  for (size_t i = 0; i < spread.size(); ++i)
+    packed.push_back(first[i % first.size()]);
+  if (spread.size() == 1)
+  {
+    packed.push_back(packed[0]);
+    spread.push_back(spread[0]);
+  }
+
+  std::cout << std::setw(30) << std::left << "Million operations per second" << std::right << std::setw(12) << "Mops/s" << std::setw(12) << "switches%" << std::endl;
+  benchmark("Packed", packed);
+  benchmark("Spread", spread);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Futex.h"
+
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <cassert>
+
+// An event count: a condition variable without a mutex, for conditions that
+// are themselves expressed in terms of atomic variables.
+//
+// Waiting for a condition:
+//
+//   while (!condition())
+//   {
+//     AIEventCount::Key key = event_count.prepare_wait();
+//     if (condition())
+//     {
+//       event_count.cancel_wait();
+//       break;
+//     }
+//     event_count.commit_wait(key);
+//   }
+//
+// Signalling it:
+//
+//   make_condition_true();
+//   event_count.notify_one();   // or notify_all().
+//
+// notify_one() and notify_all() only cost a fence and a load when nobody is
+// waiting: the futex system call is only done when there is at least one thread
+// between prepare_wait() and the end of commit_wait(). A notifier subtracts the
+// threads that it woke up from that count itself, so that subsequent notify calls
+// are cheap again right away, instead of only after the woken threads got to run.
+//
+// Like a condition variable, commit_wait() can return without a notify (and
+// notify_one() can wake up a thread that started to wait after it); the caller
+// must always re-check its condition.
+//
+// Why no wake-up can be lost
+// --------------------------
+//
+// Let the waiter do
+//   A: m_waiters.fetch_add(1)     K: key = m_epoch.load(seq_cst)
+//   Fw: seq_cst fence             C: load of the condition
+// and the notifier
+//   X: store that makes the condition true
+//   Fn: seq_cst fence             L: load of m_waiters
+//   B: m_epoch.fetch_add(1, seq_cst), followed by a futex wake.
+//
+// The two fences are totally ordered in the single total order S of all seq_cst operations.
+//
+// - If Fn precedes Fw in S: X is sequenced before Fn and C after Fw, so C sees X
+//   (or a later value) and the waiter calls cancel_wait() instead of sleeping.
+// - If Fw precedes Fn in S: A is sequenced before Fw and L after Fn, so L sees the
+//   increment by A (it can't have been undone yet, because that happens in commit_wait())
+//   and the notifier executes B. Moreover K precedes Fw and Fn precedes B in S, so K
+//   precedes B in S and the seq_cst load K can not read the value written by B.
+//   Therefore commit_wait() finds m_epoch != key: either before it calls futex wait
+//   (which then returns immediately because the futex word changed), or because the
+//   futex wake that follows B wakes it up (or another thread).
+//
+// In both cases no thread sleeps past a notify that happened after the last time
+// that it saw the condition being false, unless another waiter was woken instead.
+class AIEventCount
+{
+  public:
+    // The epoch at the moment of prepare_wait().
+    class Key
+    {
+      private:
+        friend class AIEventCount;
+        uint32_t m_epoch;
+        explicit Key(uint32_t epoch) : m_epoch(epoch) { }
+    };
+
+  private:
+    // Both words share a cache line; a notifier that finds no waiters only reads it.
+    alignas(8) std::atomic<uint32_t> m_epoch{0};        // The futex word, incremented by every notify that sees a waiter.
+    std::atomic<uint32_t> m_waiters{0};                 // The number of threads between prepare_wait() and the end of commit_wait() / cancel_wait().
+
+    static constexpr uint32_t waiter_bit = 1;
+
+    bool notify(int count)
+    {
+      std::atomic_thread_fence(std::memory_order_seq_cst);                      // Fn
+      if (m_waiters.load(std::memory_order_relaxed) == 0)                       // L
+        return false;
+      m_epoch.fetch_add(1, std::memory_order_seq_cst);                          // B
+      int woken = threadsafe::futex::wake(m_epoch, count, waiter_bit);
+      // Threads that were woken up by us don't decrement m_waiters themselves.
+      if (woken > 0)
+        m_waiters.fetch_sub(woken, std::memory_order_relaxed);
+      return true;
+    }
+
+  public:
+    // Announce that the calling thread is about to wait. The caller must then
+    // re-check its condition and call either cancel_wait() or commit_wait().
+    [[nodiscard]] Key prepare_wait()
+    {
+      m_waiters.fetch_add(1, std::memory_order_relaxed);                        // A
+      Key key(m_epoch.load(std::memory_order_seq_cst));                         // K
+      std::atomic_thread_fence(std::memory_order_seq_cst);                      // Fw
+      return key;
+    }
+
+    // The condition became true after prepare_wait(); don't wait.
+    void cancel_wait()
+    {
+      [[maybe_unused]] uint32_t prev = m_waiters.fetch_sub(1, std::memory_order_relaxed);
+      assert(prev > 0);
+    }
+
+    // Block until a notify_one() or notify_all() that happened after prepare_wait() returned key.
+    // Might return spuriously.
+    void commit_wait(Key key)
+    {
+      if (m_epoch.load(std::memory_order_acquire) == key.m_epoch &&
+          threadsafe::futex::wait(m_epoch, key.m_epoch, waiter_bit) == 0)
+        return;         // Woken up by notify(), which already removed us from m_waiters.
+      // The epoch changed before we went to sleep, or we were interrupted.
+      [[maybe_unused]] uint32_t prev = m_waiters.fetch_sub(1, std::memory_order_relaxed);
+      assert(prev > 0);
+    }
+
+    // Wake up at least one waiting thread, if any.
+    // Returns true if there were threads waiting (or about to).
+    bool notify_one() { return notify(1); }
+
+    // Wake up all waiting threads.
+    // Returns true if there were threads waiting (or about to).
+    bool notify_all() { return notify(INT_MAX); }
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "Futex.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <cassert>
+
+// A read/write mutex with the interface of AIReadWriteMutex that is built on
+// a single 32-bit futex word instead of a std::mutex plus std::condition_variable.
+//
+// The uncontended paths are a single compare-and-swap. Waiting readers,
+// waiting writers and the thread that converts its read lock into a write
+// lock sleep on the same word, but with different futex bitsets, so that:
+//
+// - When a writer releases the lock and no writer is waiting, all waiting
+//   readers are woken with a single FUTEX_WAKE.
+// - When the lock is released while writers are waiting, the write lock is
+//   handed off (the HANDOFF bit) and exactly one waiting writer is woken.
+//   Newly arriving writers cannot steal a handed-off lock.
+// - The last reader to leave wakes the converting thread directly.
+//
+// Writers have precedence over new readers.
+//
+// In addition to the AIReadWriteMutex interface there are try_rdlock() and
+// try_wrlock(), that never wait, and rdlock_until() and wrlock_until(), that
+// give up when a deadline passed (see TryAccess.h). A writer that gives up
+// while the lock is being handed off to it takes the lock anyway.
+class AIFutexReadWriteMutex
+{
+  private:
+    // Layout of m_state.
+    static constexpr uint32_t reader_mask = 0x0000ffff;        // Number of read locks.
+    static constexpr uint32_t one_reader = 0x00000001;
+    static constexpr uint32_t waiting_writers_mask = 0x0fff0000; // Number of threads waiting in wrlock().
+    static constexpr uint32_t one_waiting_writer = 0x00010000;
+    static constexpr uint32_t writer = 0x10000000;              // Write locked.
+    static constexpr uint32_t handoff = 0x20000000;             // Released to one of the waiting writers, which still has to claim it.
+    static constexpr uint32_t converting = 0x40000000;          // A reader is converting its read lock into a write lock.
+    static constexpr uint32_t readers_waiting = 0x80000000;     // At least one thread is waiting in rdlock() or rd2wryield().
+
+    // Futex bitsets.
+    static constexpr uint32_t reader_bit = 1;
+    static constexpr uint32_t writer_bit = 2;
+    static constexpr uint32_t converter_bit = 4;
+
+    std::atomic<uint32_t> m_state{0};
+
+  public:
+    void rdlock()
+    {
+      rdlock(nullptr);
+    }
+
+    bool try_rdlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!(state & (writer | handoff | converting | waiting_writers_mask)))
+      {
+        assert((state & reader_mask) != reader_mask);
+        if (m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed))
+          return true;
+      }
+      return false;
+    }
+
+    // Like rdlock(), but give up when deadline passed. Returns true if the lock was obtained.
+    template<typename CLOCK, typename DURATION>
+    bool rdlock_until(std::chrono::time_point<CLOCK, DURATION> const& deadline)
+    {
+      timespec const monotonic_deadline = threadsafe::futex::monotonic_deadline(deadline);
+      return rdlock(&monotonic_deadline);
+    }
+
+    void rdunlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      uint32_t new_state;
+      do
+      {
+        assert((state & reader_mask) > 0);
+        new_state = state - one_reader;
+        // Hand the lock to a waiting writer when we are the last reader.
+        if ((new_state & (reader_mask | converting)) == 0 && (new_state & waiting_writers_mask))
+          new_state = (new_state - one_waiting_writer) | handoff;
+      }
+      while (!m_state.compare_exchange_weak(state, new_state, std::memory_order_release, std::memory_order_relaxed));
+      if ((new_state & handoff))
+        threadsafe::futex::wake(m_state, 1, writer_bit);
+      else if ((new_state & converting) && (new_state & reader_mask) == one_reader)
+        threadsafe::futex::wake(m_state, 1, converter_bit);
+    }
+
+    void wrlock()
+    {
+      wrlock(nullptr);
+    }
+
+    bool try_wrlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!(state & (reader_mask | writer | handoff | converting)))
+        if (m_state.compare_exchange_weak(state, state | writer, std::memory_order_acquire, std::memory_order_relaxed))
+          return true;
+      return false;
+    }
+
+    // Like wrlock(), but give up when deadline passed. Returns true if the lock was obtained.
+    template<typename CLOCK, typename DURATION>
+    bool wrlock_until(std::chrono::time_point<CLOCK, DURATION> const& deadline)
+    {
+      timespec const monotonic_deadline = threadsafe::futex::monotonic_deadline(deadline);
+      return wrlock(&monotonic_deadline);
+    }
+
+    void wrunlock()
+    {
+      uint32_t state = writer;
+      if (m_state.compare_exchange_strong(state, 0, std::memory_order_release, std::memory_order_relaxed))
+        return;
+      uint32_t new_state;
+      do
+      {
+        assert((state & writer));
+        if ((state & waiting_writers_mask))
+          new_state = ((state & ~writer) - one_waiting_writer) | handoff;
+        else
+          new_state = state & ~(writer | readers_waiting);
+      }
+      while (!m_state.compare_exchange_weak(state, new_state, std::memory_order_release, std::memory_order_relaxed));
+      if ((new_state & handoff))
+        threadsafe::futex::wake(m_state, 1, writer_bit);
+      else if ((state & readers_waiting))
+        threadsafe::futex::wake(m_state, INT_MAX, reader_bit);
+    }
+
+    // Convert a read lock into a write lock.
+    // Throws when another thread is already converting; the caller must then
+    // release its read lock, call rd2wryield() and try again.
+    void rd2wrlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      do
+      {
+        assert((state & reader_mask) > 0);
+        if ((state & converting))
+          throw std::exception();
+      }
+      while (!m_state.compare_exchange_weak(state, state | converting, std::memory_order_relaxed));
+      state |= converting;
+      for (;;)
+      {
+        if ((state & reader_mask) == one_reader)
+        {
+          if (m_state.compare_exchange_weak(state, ((state & ~converting) - one_reader) | writer, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+          continue;
+        }
+        threadsafe::futex::wait(m_state, state, converter_bit);
+        state = m_state.load(std::memory_order_relaxed);
+      }
+    }
+
+    void wr2rdlock()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while (!m_state.compare_exchange_weak(state, ((state & ~(writer | readers_waiting)) + one_reader), std::memory_order_release, std::memory_order_relaxed))
+        ;
+      if ((state & readers_waiting))
+        threadsafe::futex::wake(m_state, INT_MAX, reader_bit);
+    }
+
+    // Block until the thread that is converting its read lock has succeeded.
+    void rd2wryield()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      while ((state & converting))
+      {
+        wait_as_reader(state);
+        state = m_state.load(std::memory_order_relaxed);
+      }
+    }
+
+  private:
+    // Returns false when deadline (if not null) passed before the lock could be obtained.
+    bool rdlock(timespec const* deadline)
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        if (!(state & (writer | handoff | converting | waiting_writers_mask)))
+        {
+          assert((state & reader_mask) != reader_mask);
+          if (m_state.compare_exchange_weak(state, state + one_reader, std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+          continue;
+        }
+        if (!wait_as_reader(state, deadline))
+          return false;
+      }
+    }
+
+    bool wrlock(timespec const* deadline)
+    {
+      uint32_t state = 0;
+      if (m_state.compare_exchange_strong(state, writer, std::memory_order_acquire, std::memory_order_relaxed))
+        return true;
+      bool counted = false;     // Set when we are included in waiting_writers_mask.
+      for (;;)
+      {
+        if (counted && (state & handoff))
+        {
+          // The lock was handed off to one of the waiting writers (the one that was counted for us was removed already).
+          if (m_state.compare_exchange_weak(state, (state & ~handoff) | writer, std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+          continue;
+        }
+        if (!(state & (reader_mask | writer | handoff | converting)))
+        {
+          if (m_state.compare_exchange_weak(state, (state | writer) - (counted ? one_waiting_writer : 0), std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+          continue;
+        }
+        if (!counted)
+        {
+          assert((state & waiting_writers_mask) != waiting_writers_mask);
+          if (!m_state.compare_exchange_weak(state, state + one_waiting_writer, std::memory_order_relaxed))
+            continue;
+          state += one_waiting_writer;
+          counted = true;
+        }
+        if (threadsafe::futex::wait(m_state, state, writer_bit, deadline) == ETIMEDOUT)
+          return stop_waiting_as_writer();
+        state = m_state.load(std::memory_order_relaxed);
+      }
+    }
+
+    // Called by a waiting (counted) writer whose deadline passed.
+    // Returns true if it obtained the lock after all.
+    bool stop_waiting_as_writer()
+    {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      uint32_t new_state;
+      for (;;)
+      {
+        // Don't drop a lock that was just handed off; there might not be another waiting writer to take it.
+        if ((state & handoff) || !(state & (reader_mask | writer | converting)))
+        {
+          new_state = (state & handoff) ? (state & ~handoff) | writer : (state | writer) - one_waiting_writer;
+          if (m_state.compare_exchange_weak(state, new_state, std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+          continue;
+        }
+        new_state = state - one_waiting_writer;
+        if (m_state.compare_exchange_weak(state, new_state, std::memory_order_relaxed))
+          break;
+      }
+      // Readers that were only held back by waiting writers won't be woken up by anyone else.
+      if (!(new_state & waiting_writers_mask) && (new_state & readers_waiting))
+        threadsafe::futex::wake(m_state, INT_MAX, reader_bit);
+      return false;
+    }
+
+    // Sleep until woken up as reader; state is the last value read from m_state
+    // and is updated before returning. Returns false when deadline (if not null) passed.
+    bool wait_as_reader(uint32_t& state, timespec const* deadline = nullptr)
+    {
+      if (!(state & readers_waiting))
+      {
+        if (!m_state.compare_exchange_weak(state, state | readers_waiting, std::memory_order_relaxed))
+          return true;
+        state |= readers_waiting;
+      }
+      int res = threadsafe::futex::wait(m_state, state, reader_bit, deadline);
+      state = m_state.load(std::memory_order_relaxed);
+      return res != ETIMEDOUT;
+    }
+};
@@ -1,10 +1,13 @@
 #include "threadsafe/AIReadWriteMutex.h"
+#include "AIFutexReadWriteMutex.h"
 
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <cassert>
 #include <algorithm>
+#include <chrono>
+#include <functional>
 
 constexpr unsigned int size_of_count = 33;
 long volatile count[size_of_count];
@@ -35,9 +38,8 @@ inline void read(int i)
   --read_access;
 }
 
-AIReadWriteMutex m;
-
-void run()
+template<typename MUTEX>
+void run(MUTEX& m)
 {
   int thr = ++thr_count;
   double sum = 0;
@@ -75,12 +77,20 @@ void run()
   std::cout << "Thread " << thr << " finished: needed on average " << (sum / n) << " tries.\n";
 }
 
-int main()
+// Run the workload with MUTEX and return the wall clock time in milliseconds.
+template<typename MUTEX>
+double test()
 {
+  MUTEX m;
+  thr_count = 0;
+  max_readers = 0;
+  count[0] = 0;
+
+  auto start = std::chrono::steady_clock::now();
   std::vector<std::thread> thread_pool;
   for (int i = 0; i < number_of_threads; ++i)
   {
-    thread_pool.emplace(thread_pool.end(), run);
+    thread_pool.emplace(thread_pool.end(), run<MUTEX>, std::ref(m));
   }
   std::cout << "All started!" << std::endl;
 
@@ -88,8 +98,21 @@ int main()
   {
     thread_pool[i].join();
   }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
   std::cout << "All finished!" << std::endl;
 
   std::cout << max_readers << " simultaneous readers!" << std::endl;
   std::cout << "count = " << count[0] << std::endl;
+  assert(count[0] == 0);
+  return ms;
+}
+
+int main()
+{
+  std::cout << "AIReadWriteMutex:" << std::endl;
+  double before = test<AIReadWriteMutex>();
+  std::cout << "AIFutexReadWriteMutex:" << std::endl;
+  double after = test<AIFutexReadWriteMutex>();
+
+  std::cout << "AIReadWriteMutex: " << before << " ms; AIFutexReadWriteMutex: " << after << " ms (" << (before / after) << "x)." << std::endl;
 }
@@ -1,13 +1,22 @@
 #include "sys.h"
 #include "microbench/microbench.h"
 #include "threadsafe/AIReadWriteSpinLock.h"
+#include "AIBackoffReadWriteSpinLock.h"
+#include "LatencyHistogram.h"
+#include "PerfCounters.h"
+#include "CpuTopology.h"
 #include "debug.h"
 
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <string>
+#include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
 
 constexpr unsigned int size_of_count = 33;
 long volatile count[size_of_count];
@@ -63,6 +72,9 @@ void run()
 }
 
 int volatile x = 0;
+std::atomic<bool> bench_done;
+std::vector<int> bench_cpus;            // The CPUs that bench_run pins its threads to, or empty.
+int bench_threads;
 
 void bench_mark0()
 {
@@ -80,8 +92,10 @@ void bench_run()
 {
   Debug(NAMESPACE_DEBUG::init_thread());
   int thr = ++thr_count;
+  if (!bench_cpus.empty())
+    threadsafe::CpuTopology::pin_current_thread(bench_cpus[thr - 1]);
 
-  if (thr == number_of_threads)
+  if (thr == bench_threads)
   {
     // Bench mark.
     moodycamel::stats_t stats = moodycamel::microbench_stats(&bench_mark0, 1000000, 20);
@@ -95,20 +109,183 @@ void bench_run()
       stats.q1() * 1000000,
       stats.median() * 1000000,
       stats.q3() * 1000000);
+
+    // The above are averages over batches of 1000000 calls; time every call to see the tail.
+    // This includes the overhead of reading the clock twice.
+    using clock_type = std::chrono::steady_clock;
+    threadsafe::LatencyHistogram histogram;
+    for (int i = 0; i < 1000000; ++i)
+    {
+      auto start = clock_type::now();
+      bench_mark0();
+      histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+    }
+    std::cout << std::setw(16) << std::left << "latency in ns" << std::right;
+    threadsafe::LatencyHistogram::print_header(std::cout);
+    std::cout << "\nThread " << std::setw(9) << std::left << thr << std::right << histogram << std::endl;
+
+    // And once more, without the clock, counting what the calls cost the CPU.
+    threadsafe::PerfCounters counters;
+    counters.start();
+    for (int i = 0; i < 1000000; ++i)
+      bench_mark0();
+    counters.stop();
+    std::cout << std::setw(16) << ' ';
+    threadsafe::PerfCounters::print_header(std::cout);
+    std::cout << "\nThread " << std::setw(9) << std::left << thr << std::right;
+    threadsafe::PerfCounters::print(std::cout, counters.read(), 1000000);
+    std::cout << std::endl;
+    bench_done = true;
   }
   else
   {
-    for (int j = 0; j < 20; ++j)
+    // Keep the neighbor busy until all measurements are done.
+    while (!bench_done)
       for (int i = 0; i < 1000000; ++i)
         bench_mark1();
   }
   std::cout << "Thread " << thr << " finished.\n";
 }
 
-int main()
+// Run more threads than there are CPUs on a single lock: every operation takes
+// a read lock, and every tenth a write lock, for cs_ns nanoseconds.
+// Prints the wall clock time and the CPU time used by all threads together,
+// and the performance counters of all threads per operation.
+template<typename LOCK>
+void oversubscribed(char const* name, int cs_ns, int ops)
+{
+  using clock_type = std::chrono::steady_clock;
+  int const threads = 2 * std::max(1U, std::thread::hardware_concurrency());
+  LOCK lock;
+
+  auto critical_section = [cs_ns]{
+    auto const end = clock_type::now() + std::chrono::nanoseconds(cs_ns);
+    while (clock_type::now() < end)
+      ;
+  };
+
+  threadsafe::PerfCounters counters(true);
+  counters.start();
+  std::clock_t cpu_start = std::clock();
+  auto start = clock_type::now();
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops; ++i)
+      {
+        if (i % 10 == 0)
+        {
+          lock.wrlock();
+          critical_section();
+          lock.wrunlock();
+        }
+        else
+        {
+          lock.rdlock();
+          critical_section();
+          lock.rdunlock();
+        }
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  double wall_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+  double cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  counters.stop();
+
+  std::cout << std::left << std::setw(44) << name << std::right << std::setw(8) << threads << std::setw(12) << cs_ns <<
+    std::fixed << std::setprecision(1) << std::setw(12) << wall_ms << std::setw(12) << cpu_ms;
+  threadsafe::PerfCounters::print(std::cout, counters.read(), static_cast<double>(threads) * ops);
+  std::cout << std::endl;
+}
+
+void oversubscribed_benchmark()
+{
+  using namespace threadsafe::backoff;
+  std::cout << std::left << std::setw(44) << "lock" << std::right << std::setw(8) << "threads" << std::setw(12) << "cs ns" <<
+    std::setw(12) << "wall ms" << std::setw(12) << "cpu ms";
+  threadsafe::PerfCounters::print_header(std::cout);
+  std::cout << std::endl;
+  // Nanosecond and millisecond critical sections.
+  for (auto [cs_ns, ops] : { std::pair{100, 20000}, std::pair{1000000, 20} })
+  {
+    oversubscribed<AIReadWriteSpinLock>("AIReadWriteSpinLock", cs_ns, ops);
+    oversubscribed<AIBackoffReadWriteSpinLock<Spin>>("AIBackoffReadWriteSpinLock<Spin>", cs_ns, ops);
+    oversubscribed<AIBackoffReadWriteSpinLock<Exponential<>>>("AIBackoffReadWriteSpinLock<Exponential<>>", cs_ns, ops);
+    oversubscribed<AIBackoffReadWriteSpinLock<SpinThenPark<>>>("AIBackoffReadWriteSpinLock<SpinThenPark<>>", cs_ns, ops);
+  }
+}
+
+// Run bench_run with one thread per CPU in cpus, or number_of_threads unpinned threads if cpus is empty.
+void bench(std::string const& placement, std::vector<int> const& cpus)
+{
+  std::cout << "Placement " << placement;
+  if (!cpus.empty())
+  {
+    std::cout << " (CPUs";
+    for (int cpu : cpus)
+      std::cout << ' ' << cpu;
+    std::cout << ')';
+  }
+  std::cout << ':' << std::endl;
+
+  bench_cpus = cpus;
+  bench_threads = cpus.empty() ? number_of_threads : cpus.size();
+  bench_done = false;
+  thr_count = 0;
+  std::vector<std::thread> thread_pool;
+  for (int i = 0; i < bench_threads; ++i)
+    thread_pool.emplace(thread_pool.end(), bench_run);
+  std::cout << "All started!" << std::endl;
+
+  for (auto& thread : thread_pool)
+    thread.join();
+  std::cout << "All finished!" << std::endl;
+}
+
+// Usage: AIReadWriteSpinLock_test [--placement unpinned|packed|spread|same-core|same-cluster|across-packages|all]... [--cpus LIST]...
+//
+// Runs bench_run for every given placement of its threads (see CpuTopology::placement), and
+// for every given list of CPUs (for example 0,2,4-7) to reproduce a particular deployment.
+// The default is all placements. Placements that are not possible on this machine are skipped.
+int main(int argc, char* argv[])
 {
   Debug(NAMESPACE_DEBUG::init());
 
+  using threadsafe::CpuTopology;
+  CpuTopology const& topology = CpuTopology::instance();
+  std::vector<std::pair<std::string, std::vector<int>>> placements;
+  auto add_placement = [&](std::string const& name){
+    if (name == "unpinned")
+      placements.emplace_back(name, std::vector<int>{});
+    for (int p = 0; p < CpuTopology::number_of_placements; ++p)
+      if (name == "all" || name == CpuTopology::placement_names[p])
+        placements.emplace_back(CpuTopology::placement_names[p], topology.placement(static_cast<CpuTopology::Placement>(p), number_of_threads));
+  };
+  for (int i = 1; i < argc; ++i)
+  {
+    bool const has_value = i + 1 < argc;
+    std::size_t const size = placements.size();
+    if (std::strcmp(argv[i], "--placement") == 0 && has_value)
+      add_placement(argv[++i]);
+    else if (std::strcmp(argv[i], "--cpus") == 0 && has_value && !CpuTopology::parse_cpu_list(argv[i + 1]).empty())
+    {
+      placements.emplace_back(std::string("cpus ") + argv[i + 1], CpuTopology::parse_cpu_list(argv[i + 1]));
+      ++i;
+    }
+    if (placements.size() == size)
+    {
+      std::cerr << "Usage: " << argv[0] << " [--placement unpinned|packed|spread|same-core|same-cluster|across-packages|all]... [--cpus LIST]..." << std::endl;
+      return 1;
+    }
+  }
+  if (placements.empty())
+  {
+    add_placement("unpinned");
+    add_placement("all");
+  }
+
   std::vector<std::thread> thread_pool;
   for (int i = 0; i < number_of_threads; ++i)
   {
@@ -125,17 +302,13 @@ int main()
   std::cout << max_readers << " simultaneous readers!" << std::endl;
   std::cout << "count = " << count[0] << std::endl;
 
-  thread_pool.clear();
-  thr_count = 0;
-  for (int i = 0; i < number_of_threads; ++i)
+  for (auto const& [placement, cpus] : placements)
   {
-    thread_pool.emplace(thread_pool.end(), bench_run);
+    if (placement != "unpinned" && cpus.empty())
+      std::cout << "Placement " << placement << ": not possible on this machine." << std::endl;
+    else
+      bench(placement, cpus);
   }
-  std::cout << "All started!" << std::endl;
 
-  for (int i = 0; i < number_of_threads; ++i)
-  {
-    thread_pool[i].join();
-  }
-  std::cout << "All finished!" << std::endl;
+  oversubscribed_benchmark();
 }
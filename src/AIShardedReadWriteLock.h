@@ -0,0 +1,124 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "ThreadSlot.h"
+
+#include <atomic>
+#include <thread>
+#include <exception>
+
+// A big-reader lock.
+//
+// Every reader only touches the reader counter of its own shard, which lives
+// in a cache line of its own; shards are selected by thread_slot(). As a result
+// uncontended rdlock()/rdunlock() pairs on different cores do not bounce a
+// shared cache line. The price is paid by writers, which have to sweep all
+// shards and wait until every one of them is empty.
+//
+// Use this for objects that are read very often by many threads and rarely
+// written. The interface is that of AIReadWriteSpinLock, so it can be used with
+// policy::ReadWrite; see policy::ShardedReadWrite below.
+template<unsigned int number_of_shards = 32>
+class AIShardedReadWriteLock
+{
+  private:
+    static constexpr int no_writer = 0;
+    static constexpr int writer = 1;            // Write locked, or a writer is waiting for the readers to leave.
+    static constexpr int converting = 2;        // A reader is converting its read lock into a write lock.
+
+    struct alignas(threadsafe::cache_line_size) Shard
+    {
+      std::atomic<int> m_readers{0};
+    };
+
+    Shard m_shards[number_of_shards];
+    alignas(threadsafe::cache_line_size) std::atomic<int> m_writer{no_writer};
+
+    static Shard& own_shard(Shard* shards) { return shards[threadsafe::thread_slot() % number_of_shards]; }
+
+  public:
+    void rdlock()
+    {
+      Shard& shard(own_shard(m_shards));
+      for (;;)
+      {
+        // Increment our counter before looking at m_writer, while the writer does
+        // the reverse; both sides use seq_cst so that at least one of them sees the other.
+        shard.m_readers.fetch_add(1, std::memory_order_seq_cst);
+        if (m_writer.load(std::memory_order_seq_cst) == no_writer)
+          return;
+        shard.m_readers.fetch_sub(1, std::memory_order_relaxed);
+        while (m_writer.load(std::memory_order_relaxed) != no_writer)
+          std::this_thread::yield();
+      }
+    }
+
+    void rdunlock()
+    {
+      own_shard(m_shards).m_readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void wrlock()
+    {
+      int expected = no_writer;
+      while (!m_writer.compare_exchange_weak(expected, writer, std::memory_order_seq_cst, std::memory_order_relaxed))
+      {
+        expected = no_writer;
+        std::this_thread::yield();
+      }
+      wait_for_readers(nullptr);
+    }
+
+    void wrunlock()
+    {
+      m_writer.store(no_writer, std::memory_order_release);
+    }
+
+    // Convert a read lock into a write lock.
+    // Throws when another thread is already writing or waiting to write; the caller
+    // must then release its read lock, call rd2wryield() and try again.
+    void rd2wrlock()
+    {
+      int expected = no_writer;
+      if (!m_writer.compare_exchange_strong(expected, converting, std::memory_order_seq_cst, std::memory_order_relaxed))
+        throw std::exception();
+      Shard& shard(own_shard(m_shards));
+      wait_for_readers(&shard);
+      // We are the only reader left; drop our own read lock.
+      shard.m_readers.fetch_sub(1, std::memory_order_relaxed);
+      m_writer.store(writer, std::memory_order_relaxed);
+    }
+
+    void wr2rdlock()
+    {
+      own_shard(m_shards).m_readers.fetch_add(1, std::memory_order_relaxed);
+      m_writer.store(no_writer, std::memory_order_release);
+    }
+
+    // Block until the thread that converts its read lock into a write lock (or any other writer) is done.
+    void rd2wryield()
+    {
+      while (m_writer.load(std::memory_order_acquire) != no_writer)
+        std::this_thread::yield();
+    }
+
+  private:
+    // Wait until all shards are empty, except for the read lock held by the caller in shard `own` (if any).
+    void wait_for_readers(Shard* own)
+    {
+      for (unsigned int i = 0; i < number_of_shards; ++i)
+      {
+        Shard& shard(m_shards[i]);
+        int const own_readers = &shard == own ? 1 : 0;
+        while (shard.m_readers.load(std::memory_order_seq_cst) != own_readers)
+          std::this_thread::yield();
+      }
+    }
+};
+
+namespace threadsafe::policy {
+
+// Drop-in policy for read-dominated objects: Unlocked<T, policy::ShardedReadWrite>.
+using ShardedReadWrite = ReadWrite<AIShardedReadWriteLock<>>;
+
+} // namespace threadsafe::policy
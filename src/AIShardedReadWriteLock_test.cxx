@@ -0,0 +1,164 @@
+#include "sys.h"
+#include "microbench/microbench.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "AIShardedReadWriteLock.h"
+#include "debug.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+// Compare the read side scaling of AIShardedReadWriteLock with that of AIReadWriteSpinLock:
+// all threads continuously take and release a read lock on the same lock while one
+// of them measures how long an rdlock()/rdunlock() pair takes.
+
+constexpr unsigned int size_of_count = 33;
+long volatile count[size_of_count];
+int const number_of_threads = std::min(std::thread::hardware_concurrency(), size_of_count - 1);
+int const n = 1000000;
+
+std::atomic<int> write_access;
+std::atomic<int> read_access;
+std::atomic<int> thr_count;
+std::atomic<int> max_readers;
+
+inline void add(long d, int i = 0)
+{
+  ++write_access;
+  assert(write_access == 1 && read_access == 0);
+  count[0] = count[i] + d;
+  --write_access;
+}
+
+inline void read(int i)
+{
+  ++read_access;
+  assert(write_access == 0);
+  count[i] = count[0];
+  int v = read_access;
+  if (v > max_readers)
+    max_readers = v;
+  --read_access;
+}
+
+AIShardedReadWriteLock<> m;
+
+// Correctness: mostly reads, 1% writes and some read to write conversions.
+void run()
+{
+  Debug(NAMESPACE_DEBUG::init_thread());
+
+  int thr = ++thr_count;
+  for (int i = 0; i < n; ++i)
+  {
+    if (i % 100 == 0)
+    {
+      m.wrlock();
+      add(1);
+      m.wrunlock();
+    }
+    else if (i % 100 == 50)
+    {
+      for (;;)
+      {
+        m.rdlock();
+        read(thr);
+        try
+        {
+          m.rd2wrlock();
+        }
+        catch (std::exception const&)
+        {
+          m.rdunlock();
+          m.rd2wryield();
+          continue;
+        }
+        add(1, thr);
+        m.wr2rdlock();
+        read(thr);
+        m.rdunlock();
+        break;
+      }
+    }
+    else
+    {
+      m.rdlock();
+      read(thr);
+      m.rdunlock();
+    }
+  }
+  std::cout << "Thread " << thr << " finished.\n";
+}
+
+AIReadWriteSpinLock spin_lock;
+AIShardedReadWriteLock<> sharded_lock;
+
+void bench_spin_lock()
+{
+  spin_lock.rdlock();
+  spin_lock.rdunlock();
+}
+
+void bench_sharded_lock()
+{
+  sharded_lock.rdlock();
+  sharded_lock.rdunlock();
+}
+
+template<void (*bench_mark)()>
+void bench_run(char const* name)
+{
+  Debug(NAMESPACE_DEBUG::init_thread());
+  int thr = ++thr_count;
+
+  if (thr == number_of_threads)
+  {
+    moodycamel::stats_t stats = moodycamel::microbench_stats(bench_mark, 1000000, 20);
+
+    printf("%s, thread %d statistics: avg: %.2fns, min: %.2fns, max: %.2fns, stddev: %.2fns, Q1: %.2fns, median: %.2fns, Q3: %.2fns\n",
+      name,
+      thr,
+      stats.avg() * 1000000,
+      stats.min() * 1000000,
+      stats.max() * 1000000,
+      stats.stddev() * 1000000,
+      stats.q1() * 1000000,
+      stats.median() * 1000000,
+      stats.q3() * 1000000);
+  }
+  else
+  {
+    for (int j = 0; j < 20; ++j)
+      for (int i = 0; i < 1000000; ++i)
+        bench_mark();
+  }
+}
+
+template<void (*bench_mark)()>
+void bench(char const* name)
+{
+  std::vector<std::thread> thread_pool;
+  thr_count = 0;
+  for (int i = 0; i < number_of_threads; ++i)
+    thread_pool.emplace_back(bench_run<bench_mark>, name);
+  for (auto& thread : thread_pool)
+    thread.join();
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::vector<std::thread> thread_pool;
+  for (int i = 0; i < number_of_threads; ++i)
+    thread_pool.emplace_back(run);
+  for (auto& thread : thread_pool)
+    thread.join();
+  std::cout << max_readers << " simultaneous readers!" << std::endl;
+  std::cout << "count = " << count[0] << std::endl;
+
+  bench<bench_spin_lock>("AIReadWriteSpinLock");
+  bench<bench_sharded_lock>("AIShardedReadWriteLock");
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "ThreadSlot.h"
+
+#include <atomic>
+#include <utility>
+
+// A reference count that many threads can increment and decrement at the same
+// time without fighting over one cache line.
+//
+// The count is split over number_of_shards counters, each on its own cache line,
+// plus a central count. A thread increments the shard of its thread_slot(); only
+// when that shard goes from zero to one (or back) is the central count touched.
+// The central count therefore equals the number of non-empty shards plus the
+// number of references that were taken on the central count directly (by
+// boost::intrusive_ptr); the object is deleted when it drops to zero.
+//
+// A sharded reference must be released on the shard that it was taken on, which
+// is not necessarily the shard of the releasing thread; ShardedRefPtr remembers it.
+//
+// Correctness does not depend on which threads share a shard: the shard counters
+// are atomic, they are just rarely contended. The central count is only left alone
+// when the thread already holds a reference in its shard, so this pays off for
+// threads that keep a reference of their own and copy that around.
+class AIShardedRefCount
+{
+  public:
+    static constexpr unsigned int number_of_shards = 16;
+
+  private:
+    struct alignas(threadsafe::cache_line_size) Shard
+    {
+      std::atomic<int> m_count{0};
+    };
+
+    mutable Shard m_shards[number_of_shards];
+    alignas(threadsafe::cache_line_size) mutable std::atomic<int> m_count{0};
+
+    void release_central() const
+    {
+      if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+    }
+
+  public:
+    virtual ~AIShardedRefCount() = default;
+
+    // Add a reference to the shard of the calling thread and return the index of that shard.
+    // The caller must already own a reference (or be the creator of the object).
+    unsigned int add_sharded_ref() const
+    {
+      unsigned int shard_index = threadsafe::thread_slot() % number_of_shards;
+      // When the shard was empty it must be accounted for in the central count.
+      // Until that is done the reference of the caller, which is counted elsewhere
+      // (if it were counted in this shard, the shard wasn't empty), keeps the central
+      // count above zero.
+      if (m_shards[shard_index].m_count.fetch_add(1, std::memory_order_relaxed) == 0)
+        m_count.fetch_add(1, std::memory_order_relaxed);
+      return shard_index;
+    }
+
+    // Release a reference that was obtained from add_sharded_ref() on shard shard_index.
+    void release_sharded_ref(unsigned int shard_index) const
+    {
+      // Release, so that all accesses through this reference happen before a
+      // possible delete by another thread; and acquire, so that the thread that
+      // empties the shard (and might delete the object through release_central())
+      // synchronizes with all earlier releases on this shard.
+      if (m_shards[shard_index].m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        release_central();
+    }
+
+    // Support for boost::intrusive_ptr; these use the (contended) central count.
+    friend void intrusive_ptr_add_ref(AIShardedRefCount const* ptr)
+    {
+      ptr->m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    friend void intrusive_ptr_release(AIShardedRefCount const* ptr)
+    {
+      ptr->release_central();
+    }
+};
+
+// A smart pointer to an object derived from AIShardedRefCount, like
+// boost::intrusive_ptr, that uses sharded references.
+template<typename T>
+class ShardedRefPtr
+{
+  private:
+    T* m_ptr;
+    unsigned int m_shard_index;
+
+  public:
+    ShardedRefPtr() : m_ptr(nullptr), m_shard_index(0) { }
+    explicit ShardedRefPtr(T* ptr) : m_ptr(ptr), m_shard_index(ptr ? ptr->add_sharded_ref() : 0) { }
+    ShardedRefPtr(ShardedRefPtr const& other) : ShardedRefPtr(other.m_ptr) { }
+    ShardedRefPtr(ShardedRefPtr&& other) : m_ptr(std::exchange(other.m_ptr, nullptr)), m_shard_index(other.m_shard_index) { }
+    ~ShardedRefPtr() { reset(); }
+
+    ShardedRefPtr& operator=(ShardedRefPtr other)
+    {
+      std::swap(m_ptr, other.m_ptr);
+      std::swap(m_shard_index, other.m_shard_index);
+      return *this;
+    }
+
+    void reset()
+    {
+      if (m_ptr)
+        std::exchange(m_ptr, nullptr)->release_sharded_ref(m_shard_index);
+    }
+
+    T* get() const { return m_ptr; }
+    T* operator->() const { return m_ptr; }
+    T& operator*() const { return *m_ptr; }
+    explicit operator bool() const { return m_ptr; }
+};
+
+namespace threadsafe {
+namespace policy {
+
+// Policy decorator that makes an Unlocked object reference counted with an
+// AIShardedRefCount, so that it can be shared with SharedUnlockedBase views.
+//
+//   auto* a = new Unlocked<A, policy::ShardedRefCount<policy::ReadWrite<AIReadWriteMutex>>>(42);
+//   SharedUnlockedBase<B, policy::ReadWrite<AIReadWriteMutex>> b(*a);    // Keeps *a alive.
+//
+// The object must be allocated with new. It is deleted when the last
+// SharedUnlockedBase (or boost::intrusive_ptr) that refers to it is destroyed.
+template<typename POLICY>
+struct ShardedRefCount
+{
+  using policy_type = POLICY;
+};
+
+} // namespace policy
+
+template<typename T, typename POLICY>
+class Unlocked<T, policy::ShardedRefCount<POLICY>> : public Unlocked<T, POLICY>, public AIShardedRefCount
+{
+  public:
+    using base_type = Unlocked<T, POLICY>;
+    using policy_type = policy::ShardedRefCount<POLICY>;
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) : base_type(std::forward<ARGS>(args)...) { }
+};
+
+// An UnlockedBase<T, POLICY> that owns a (sharded) reference to the object it refers to.
+//
+// Copying and destroying a SharedUnlockedBase only touches the reference count
+// shard of the calling thread, so many threads can copy views of the same object
+// concurrently.
+template<typename T, typename POLICY>
+class SharedUnlockedBase : public UnlockedBase<T, POLICY>
+{
+  private:
+    ShardedRefPtr<AIShardedRefCount const> m_owner;
+
+  public:
+    template<typename U>
+    SharedUnlockedBase(Unlocked<U, policy::ShardedRefCount<POLICY>>& unlocked) :
+      UnlockedBase<T, POLICY>(unlocked), m_owner(&unlocked) { }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,129 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "utils/AIRefCount.h"
+#include "AIShardedRefCount.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Copy/destroy throughput of views on one object shared by many threads:
+// boost::intrusive_ptr on an AIRefCount object versus SharedUnlockedBase on an
+// Unlocked<..., policy::ShardedRefCount<...>>.
+//
+// Before that, views are copied by many threads and destroyed by other threads
+// than the ones that created them, and the object must be deleted exactly once,
+// after the last view is gone.
+
+using namespace threadsafe;
+
+int const number_of_threads = std::max(4U, std::thread::hardware_concurrency());
+int constexpr ops = 2000000;
+
+std::atomic<int> destructed;
+
+class B
+{
+ public:
+  virtual ~B() { destructed.fetch_add(1, std::memory_order_relaxed); }
+  virtual int value() const = 0;
+};
+
+class A : public B
+{
+  int m_;
+
+ public:
+  A(int m) : m_(m) { }
+  int value() const override { return m_; }
+};
+
+class RefCountedA : public A, public AIRefCount
+{
+ public:
+  using A::A;
+};
+
+using policy_type = policy::ReadWrite<AIReadWriteMutex>;
+using UnlockedA = Unlocked<A, policy::ShardedRefCount<policy_type>>;
+using SharedB = SharedUnlockedBase<B, policy_type>;
+
+void test_lifetime()
+{
+  UnlockedA* a = new UnlockedA(42);
+  std::vector<std::vector<SharedB>> views(number_of_threads);
+  {
+    SharedB b(*a);
+    std::vector<std::thread> thread_pool;
+    for (int t = 0; t < number_of_threads; ++t)
+      thread_pool.emplace_back([&, t]{
+        Debug(NAMESPACE_DEBUG::init_thread());
+        for (int i = 0; i < 1000; ++i)
+          views[t].push_back(b);
+      });
+    for (auto& thread : thread_pool)
+      thread.join();
+  }
+  assert(destructed == 0);
+  assert(SharedB::crat(views[0][0])->value() == 42);
+  // Destroy the views of thread t in thread t + 1.
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < number_of_threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      views[(t + 1) % number_of_threads].clear();
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  assert(destructed == 1);
+  std::cout << "Lifetime: " << (destructed == 1 ? "Success!" : "FAILED!") << std::endl;
+  destructed = 0;
+}
+
+template<typename VIEW>
+double run(int threads, VIEW const& view)
+{
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      // Every thread keeps a view of its own, and makes short lived copies of that.
+      VIEW own_view(view);
+      for (int i = 0; i < ops; ++i)
+      {
+        VIEW copy(own_view);
+        asm volatile ("" : : "r" (&copy) : "memory");
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return threads * ops / seconds / 1e6;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_lifetime();
+
+  boost::intrusive_ptr<RefCountedA> refcounted_a = new RefCountedA(42);
+  SharedB shared_b(*new UnlockedA(42));
+
+  std::cout << "Million copies + destructions per second:" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(18) << "intrusive_ptr" << std::setw(20) << "SharedUnlockedBase" << std::endl;
+  for (int threads = 1; threads <= number_of_threads; threads *= 2)
+  {
+    double central = run(threads, refcounted_a);
+    double sharded = run(threads, shared_b);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2) << std::setw(18) << central << std::setw(20) << sharded << std::endl;
+  }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cassert>
+
+// A read/write mutex with the same interface as AIReadWriteMutex, plus
+//
+// - try_rd2wrlock(): a non-throwing read to write lock conversion that returns
+//   false where rd2wrlock() would throw (because another thread is already
+//   converting its read lock).
+// - An upgradeable read lock (urlock/urunlock). At most one thread at a time can
+//   hold it, but it coexists with ordinary readers. Converting it into a write
+//   lock (ur2wrlock) never fails, because no other thread can be converting at
+//   the same time: while an upgradeable read lock is held, rd2wrlock() throws and
+//   try_rd2wrlock() returns false.
+//
+// Typical use of the upgradeable lock is through threadsafe::UpgradeableReadAccess
+// (see UpgradeableReadAccess.h).
+class AIUpgradeableReadWriteMutex
+{
+  private:
+    std::mutex m_state_mutex;
+    std::condition_variable m_state_changed;
+    int m_readers;              // Number of read locks, including the upgradeable read lock.
+    bool m_writer;              // Set while write locked.
+    bool m_converting;          // Set while a thread is waiting in rd2wrlock / try_rd2wrlock / ur2wrlock for the other readers to leave.
+    bool m_upgrader;            // Set while the upgradeable read lock is held (also after converting it to a write lock).
+
+  public:
+    AIUpgradeableReadWriteMutex() : m_readers(0), m_writer(false), m_converting(false), m_upgrader(false) { }
+
+    void rdlock()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      m_state_changed.wait(lk, [this]{ return !m_writer && !m_converting; });
+      ++m_readers;
+    }
+
+    void rdunlock()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      assert(m_readers > 0);
+      if (--m_readers <= 1)
+      {
+        lk.unlock();
+        m_state_changed.notify_all();
+      }
+    }
+
+    void wrlock()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      m_state_changed.wait(lk, [this]{ return !m_writer && !m_converting && !m_upgrader && m_readers == 0; });
+      m_writer = true;
+    }
+
+    void wrunlock()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_state_mutex);
+        assert(m_writer);
+        m_writer = false;
+      }
+      m_state_changed.notify_all();
+    }
+
+    // Convert a read lock into a write lock.
+    // Throws if another thread is already converting (or holds the upgradeable lock);
+    // in that case the caller must release its read lock and call rd2wryield()
+    // before trying again.
+    void rd2wrlock()
+    {
+      if (!try_rd2wrlock())
+        throw std::exception();
+    }
+
+    // Same as rd2wrlock() but returns false instead of throwing.
+    [[nodiscard]] bool try_rd2wrlock()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      assert(m_readers > 0);
+      if (m_converting || m_upgrader)
+        return false;
+      convert(lk);
+      return true;
+    }
+
+    void wr2rdlock()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_state_mutex);
+        assert(m_writer);
+        m_writer = false;
+        m_readers = 1;
+      }
+      m_state_changed.notify_all();
+    }
+
+    // Block until the thread that is converting its read lock has succeeded.
+    void rd2wryield()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      m_state_changed.wait(lk, [this]{ return !m_converting && !m_upgrader; });
+    }
+
+    void urlock()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      m_state_changed.wait(lk, [this]{ return !m_writer && !m_converting && !m_upgrader; });
+      m_upgrader = true;
+      ++m_readers;
+    }
+
+    void urunlock()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_state_mutex);
+        assert(m_upgrader && m_readers > 0);
+        m_upgrader = false;
+        --m_readers;
+      }
+      m_state_changed.notify_all();
+    }
+
+    // Convert the upgradeable read lock into a write lock. Never fails.
+    void ur2wrlock()
+    {
+      std::unique_lock<std::mutex> lk(m_state_mutex);
+      assert(m_upgrader && !m_converting);
+      convert(lk);
+    }
+
+    // Convert a write lock that was obtained with ur2wrlock() back into the upgradeable read lock.
+    void wr2urlock()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_state_mutex);
+        assert(m_writer && m_upgrader);
+        m_writer = false;
+        m_readers = 1;
+      }
+      m_state_changed.notify_all();
+    }
+
+  private:
+    void convert(std::unique_lock<std::mutex>& lk)
+    {
+      m_converting = true;
+      m_state_changed.wait(lk, [this]{ return m_readers == 1; });
+      m_readers = 0;
+      m_converting = false;
+      m_writer = true;
+    }
+};
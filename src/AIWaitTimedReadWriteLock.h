@@ -0,0 +1,52 @@
+#pragma once
+
+#include "WaitStatistics.h"
+
+#include <chrono>
+#include <cstdint>
+
+// Wraps a read/write lock (AIReadWriteMutex, AIReadWriteSpinLock, ...) and
+// records how long every rdlock() and wrlock() (and successful rd2wrlock())
+// had to wait for the lock.
+//
+// Usable as drop-in replacement, including as policy::ReadWrite<AIWaitTimedReadWriteLock<LOCK>>.
+// Each lock operation costs two extra clock reads.
+template<typename LOCK>
+class AIWaitTimedReadWriteLock : public LOCK
+{
+  private:
+    using clock_type = std::chrono::steady_clock;
+
+    threadsafe::WaitStatistics m_reader_wait;
+    threadsafe::WaitStatistics m_writer_wait;
+
+    static void record(threadsafe::WaitStatistics& statistics, clock_type::time_point start)
+    {
+      statistics.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+    }
+
+  public:
+    void rdlock()
+    {
+      auto start = clock_type::now();
+      LOCK::rdlock();
+      record(m_reader_wait, start);
+    }
+
+    void wrlock()
+    {
+      auto start = clock_type::now();
+      LOCK::wrlock();
+      record(m_writer_wait, start);
+    }
+
+    void rd2wrlock()
+    {
+      auto start = clock_type::now();
+      LOCK::rd2wrlock();
+      record(m_writer_wait, start);
+    }
+
+    threadsafe::WaitStatistics const& reader_wait() const { return m_reader_wait; }
+    threadsafe::WaitStatistics const& writer_wait() const { return m_writer_wait; }
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "AIAsyncReadWriteMutex.h"
+#include "UnlockedAccessor.h"
+
+#include <coroutine>
+#include <type_traits>
+#include <utility>
+
+namespace threadsafe {
+
+// Coroutine access to Unlocked<T, policy::ReadWrite<AIAsyncReadWriteMutex>> and
+// Unlocked<T, policy::Primitive<AIAsyncReadWriteMutex>> objects.
+//
+//   Task update(unlocked_Foo_t& foo, Executor& executor)
+//   {
+//     auto foo_w = co_await async_wat(foo, executor);
+//     foo_w->x = 42;
+//   }
+//
+// When the lock is not available the coroutine is suspended instead of blocking
+// the thread; once the lock was handed over to it, the coroutine is resumed by
+// calling executor.post(handle) from the thread that released the lock.
+// With policy::Primitive, async_rat obtains the (exclusive) lock too.
+//
+// The access objects are released at the end of their scope, like a rat or wat.
+// Holding them across other co_await's is allowed: they are not tied to a thread.
+
+template<typename EXECUTOR>
+concept Executor = requires(EXECUTOR& executor, std::coroutine_handle<> handle)
+{
+  executor.post(handle);
+};
+
+template<typename UNLOCKED>
+concept AsyncUnlocked = std::is_same_v<std::remove_cvref_t<decltype(UnlockedAccessor<UNLOCKED>::get_mutex(std::declval<UNLOCKED const&>()))>, AIAsyncReadWriteMutex>;
+
+namespace detail {
+
+template<typename POLICY>
+struct is_primitive_policy : std::false_type { };
+
+template<typename MUTEX>
+struct is_primitive_policy<policy::Primitive<MUTEX>> : std::true_type { };
+
+template<typename UNLOCKED, bool writable, Executor EXECUTOR>
+class AsyncAccessAwaiter;
+
+} // namespace detail
+
+// The result of co_await async_rat(unlocked, executor) (const access), or of
+// co_await async_wat(unlocked, executor) (writable access).
+template<AsyncUnlocked UNLOCKED, bool writable>
+class AsyncAccess
+{
+  public:
+    using data_type = typename UNLOCKED::data_type;
+    using pointer_type = std::conditional_t<writable, data_type*, data_type const*>;
+
+    // Primitive only has an exclusive lock.
+    static constexpr AIAsyncReadWriteMutex::Waiter::Kind lock_kind =
+        writable || detail::is_primitive_policy<typename UNLOCKED::policy_type>::value ?
+        AIAsyncReadWriteMutex::Waiter::writer : AIAsyncReadWriteMutex::Waiter::reader;
+
+  private:
+    template<typename, bool, Executor> friend class detail::AsyncAccessAwaiter;
+    UNLOCKED* m_unlocked;
+
+    // Adopt a lock of kind that is already held.
+    explicit AsyncAccess(UNLOCKED& unlocked) : m_unlocked(&unlocked) { }
+
+  public:
+    AsyncAccess(AsyncAccess&& orig) : m_unlocked(std::exchange(orig.m_unlocked, nullptr)) { }
+    AsyncAccess& operator=(AsyncAccess&&) = delete;
+
+    ~AsyncAccess()
+    {
+      if (!m_unlocked)
+        return;
+      AIAsyncReadWriteMutex& mutex = UnlockedAccessor<UNLOCKED>::get_mutex(*m_unlocked);
+      if (lock_kind == AIAsyncReadWriteMutex::Waiter::writer)
+        mutex.wrunlock();
+      else
+        mutex.rdunlock();
+    }
+
+    pointer_type operator->() const { return UnlockedAccessor<UNLOCKED>::get_ptr(*m_unlocked); }
+    auto& operator*() const { return *operator->(); }
+};
+
+namespace detail {
+
+template<typename UNLOCKED, bool writable, Executor EXECUTOR>
+class AsyncAccessAwaiter : private AIAsyncReadWriteMutex::Waiter
+{
+  private:
+    using access_type = AsyncAccess<UNLOCKED, writable>;
+    static constexpr AIAsyncReadWriteMutex::Waiter::Kind kind = access_type::lock_kind;
+
+    UNLOCKED& m_unlocked;
+    EXECUTOR& m_executor;
+    std::coroutine_handle<> m_handle;
+
+    static void resume_on_executor(AIAsyncReadWriteMutex::Waiter* waiter)
+    {
+      AsyncAccessAwaiter* self = static_cast<AsyncAccessAwaiter*>(waiter);
+      self->m_executor.post(self->m_handle);
+    }
+
+    AIAsyncReadWriteMutex& mutex() const { return UnlockedAccessor<UNLOCKED>::get_mutex(m_unlocked); }
+
+  public:
+    AsyncAccessAwaiter(UNLOCKED& unlocked, EXECUTOR& executor) :
+      AIAsyncReadWriteMutex::Waiter(kind, &resume_on_executor), m_unlocked(unlocked), m_executor(executor) { }
+
+    bool await_ready() const
+    {
+      return kind == AIAsyncReadWriteMutex::Waiter::writer ? mutex().try_wrlock() : mutex().try_rdlock();
+    }
+
+    // Returns false (don't suspend) when the lock was obtained after all.
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+      m_handle = handle;
+      return !mutex().async_lock(this);
+    }
+
+    access_type await_resume() const { return access_type(m_unlocked); }
+};
+
+} // namespace detail
+
+template<AsyncUnlocked UNLOCKED, Executor EXECUTOR>
+detail::AsyncAccessAwaiter<UNLOCKED, true, EXECUTOR> async_wat(UNLOCKED& unlocked, EXECUTOR& executor)
+{
+  return { unlocked, executor };
+}
+
+template<AsyncUnlocked UNLOCKED, Executor EXECUTOR>
+detail::AsyncAccessAwaiter<UNLOCKED, false, EXECUTOR> async_rat(UNLOCKED& unlocked, EXECUTOR& executor)
+{
+  return { unlocked, executor };
+}
+
+} // namespace threadsafe
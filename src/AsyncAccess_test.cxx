@@ -0,0 +1,235 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "AIAsyncReadWriteMutex.h"
+#include "AsyncAccess.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <coroutine>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Coroutines that co_await async_wat / async_rat on a few shared objects, run by
+// a small thread pool, versus one thread per request that blocks in wat / rat.
+//
+// There are number_of_requests requests, far more than there are cores. Every
+// request does ops_per_request accesses to a random object; one in ten is a write
+// that holds the lock for write_hold, the others are reads that hold it for
+// read_hold. The total of all writes is checked afterwards.
+
+using namespace threadsafe;
+
+int const number_of_workers = std::max(2U, std::thread::hardware_concurrency());
+int constexpr number_of_requests = 512;
+int constexpr ops_per_request = 200;
+int constexpr number_of_objects = 4;
+auto constexpr write_hold = std::chrono::microseconds(20);
+auto constexpr read_hold = std::chrono::microseconds(2);
+
+// A minimal executor: a FIFO of coroutines that is run by number_of_workers threads.
+class ThreadPoolExecutor
+{
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::coroutine_handle<>> m_queue;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+
+    void run()
+    {
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (;;)
+      {
+        std::coroutine_handle<> handle;
+        {
+          std::unique_lock<std::mutex> lk(m_mutex);
+          m_cv.wait(lk, [this]{ return m_stop || !m_queue.empty(); });
+          if (m_queue.empty())
+            return;
+          handle = m_queue.front();
+          m_queue.pop_front();
+        }
+        handle.resume();
+      }
+    }
+
+  public:
+    ThreadPoolExecutor(int number_of_threads)
+    {
+      for (int i = 0; i < number_of_threads; ++i)
+        m_workers.emplace_back([this]{ run(); });
+    }
+
+    // Runs the remaining coroutines and then stops.
+    ~ThreadPoolExecutor()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      for (auto& worker : m_workers)
+        worker.join();
+    }
+
+    void post(std::coroutine_handle<> handle)
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_queue.push_back(handle);
+      }
+      m_cv.notify_one();
+    }
+
+    // Awaitable that continues the coroutine on one of the worker threads.
+    auto schedule()
+    {
+      struct Awaiter
+      {
+        ThreadPoolExecutor& m_executor;
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { m_executor.post(handle); }
+        void await_resume() const { }
+      };
+      return Awaiter{*this};
+    }
+};
+
+// A coroutine that is started immediately and destroys itself when it finishes.
+struct Task
+{
+  struct promise_type
+  {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() { }
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+struct Counter
+{
+  long total = 0;
+};
+
+using unlocked_Counter_t = Unlocked<Counter, policy::ReadWrite<AIAsyncReadWriteMutex>>;
+using unlocked_Counter_primitive_t = Unlocked<Counter, policy::Primitive<AIAsyncReadWriteMutex>>;
+
+thread_local long volatile sink;
+
+void hold(std::chrono::microseconds duration)
+{
+  auto until = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < until)
+    ;
+}
+
+template<typename UNLOCKED>
+Task request(UNLOCKED* objects, ThreadPoolExecutor& executor, int r, std::atomic<int>& remaining)
+{
+  co_await executor.schedule();
+  unsigned int random = r + 1;
+  for (int i = 0; i < ops_per_request; ++i)
+  {
+    random = random * 1103515245 + 12345;
+    UNLOCKED& object = objects[(random >> 8) % number_of_objects];
+    if (i % 10 == 0)
+    {
+      auto object_w = co_await async_wat(object, executor);
+      object_w->total += 1;
+      hold(write_hold);
+    }
+    else
+    {
+      auto object_r = co_await async_rat(object, executor);
+      sink = object_r->total;
+      hold(read_hold);
+    }
+  }
+  if (remaining.fetch_sub(1) == 1)
+    remaining.notify_one();
+}
+
+template<typename UNLOCKED>
+double run_coroutines()
+{
+  UNLOCKED objects[number_of_objects];
+  auto start = std::chrono::steady_clock::now();
+  {
+    // Declared before executor, because the last request might still be inside
+    // remaining.notify_one() on a worker until ~ThreadPoolExecutor joins it.
+    std::atomic<int> remaining{number_of_requests};
+    ThreadPoolExecutor executor(number_of_workers);
+    for (int r = 0; r < number_of_requests; ++r)
+      request(objects, executor, r, remaining);
+    for (int left = remaining.load(); left != 0; left = remaining.load())
+      remaining.wait(left);
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  long total = 0;
+  for (auto& object : objects)
+    total += typename UNLOCKED::crat(object)->total;
+  assert(total == number_of_requests * (ops_per_request / 10));
+  return ms;
+}
+
+template<typename UNLOCKED>
+double run_threads()
+{
+  UNLOCKED objects[number_of_objects];
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int r = 0; r < number_of_requests; ++r)
+    thread_pool.emplace_back([&objects, r]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      unsigned int random = r + 1;
+      for (int i = 0; i < ops_per_request; ++i)
+      {
+        random = random * 1103515245 + 12345;
+        UNLOCKED& object = objects[(random >> 8) % number_of_objects];
+        if (i % 10 == 0)
+        {
+          typename UNLOCKED::wat object_w(object);
+          object_w->total += 1;
+          hold(write_hold);
+        }
+        else
+        {
+          typename UNLOCKED::rat object_r(object);
+          sink = object_r->total;
+          hold(read_hold);
+        }
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  long total = 0;
+  for (auto& object : objects)
+    total += typename UNLOCKED::crat(object)->total;
+  assert(total == number_of_requests * (ops_per_request / 10));
+  return ms;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::cout << number_of_requests << " requests of " << ops_per_request << " accesses on " << number_of_objects << " objects; " <<
+    number_of_workers << " worker threads for the coroutines." << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "ReadWrite, coroutines:           " << std::setw(8) << run_coroutines<unlocked_Counter_t>() << " ms" << std::endl;
+  std::cout << "ReadWrite, blocking threads:     " << std::setw(8) << run_threads<unlocked_Counter_t>() << " ms" << std::endl;
+  std::cout << "Primitive, coroutines:           " << std::setw(8) << run_coroutines<unlocked_Counter_primitive_t>() << " ms" << std::endl;
+  std::cout << "Primitive, blocking threads:     " << std::setw(8) << run_threads<unlocked_Counter_primitive_t>() << " ms" << std::endl;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+
+namespace threadsafe {
+
+// Tell the CPU that we are busy-waiting.
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#else
+  asm volatile("" ::: "memory");
+#endif
+}
+
+namespace backoff {
+
+// Backoff strategies for spin locks.
+//
+// A strategy object is created at the start of each wait. Every time the
+// condition that is waited for is found to be false, the waiting thread calls
+// pause(). If that returns false the thread should stop spinning and park
+// (block in the kernel) instead; after waking up it calls reset().
+
+// Pause once per round, forever. Lowest latency for nanosecond critical
+// sections, but burns CPU for as long as the lock is held.
+struct Spin
+{
+  bool pause() { cpu_relax(); return true; }
+  void reset() { }
+};
+
+// Pause 1, 2, 4, ... up to max_pauses times per round, forever.
+// Reduces the traffic on the lock's cache line under contention.
+template<int max_pauses = 1024>
+class Exponential
+{
+  private:
+    int m_pauses = 1;
+
+  public:
+    bool pause()
+    {
+      for (int i = 0; i < m_pauses; ++i)
+        cpu_relax();
+      m_pauses = std::min(2 * m_pauses, max_pauses);
+      return true;
+    }
+
+    void reset() { m_pauses = 1; }
+};
+
+// Exponential backoff for at most max_rounds rounds, then park.
+// Good for critical sections of unknown length: short ones are still
+// caught while spinning, long ones don't steal CPU from the lock holder.
+template<int max_rounds = 12, int max_pauses = 1024>
+class SpinThenPark
+{
+  private:
+    Exponential<max_pauses> m_exponential;
+    int m_rounds = 0;
+
+  public:
+    bool pause()
+    {
+      if (m_rounds == max_rounds)
+        return false;
+      ++m_rounds;
+      return m_exponential.pause();
+    }
+
+    void reset() { m_exponential.reset(); m_rounds = 0; }
+};
+
+// Don't spin at all; park right away.
+// Turns a spin lock into a blocking mutex, for long critical sections.
+struct Park
+{
+  bool pause() { return false; }
+  void reset() { }
+};
+
+} // namespace backoff
+} // namespace threadsafe
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+
+namespace threadsafe::benchmark {
+
+// Repeated measurements of one benchmark, for example nanoseconds per operation.
+using Samples = std::vector<double>;
+
+inline double median(Samples samples)
+{
+  if (samples.empty())
+    return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t const n = samples.size();
+  return n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+}
+
+// One-sided Mann-Whitney U test.
+// Returns the probability to see current at least this much larger than baseline when both
+// come from the same distribution; a small value means that current is significantly larger.
+// Uses the normal approximation with tie and continuity correction, which is good enough
+// from about eight samples per side.
+inline double mann_whitney_p_greater(Samples const& baseline, Samples const& current)
+{
+  double const n1 = baseline.size();
+  double const n2 = current.size();
+  if (n1 == 0 || n2 == 0)
+    return 1.0;
+  double u = 0.0;                       // The number of pairs in which current is larger.
+  for (double c : current)
+    for (double b : baseline)
+      u += c > b ? 1.0 : c == b ? 0.5 : 0.0;
+  Samples all(baseline);
+  all.insert(all.end(), current.begin(), current.end());
+  std::sort(all.begin(), all.end());
+  double ties = 0.0;
+  for (size_t i = 0; i < all.size();)
+  {
+    size_t j = i;
+    while (j < all.size() && all[j] == all[i])
+      ++j;
+    double const t = j - i;
+    ties += t * t * t - t;
+    i = j;
+  }
+  double const n = n1 + n2;
+  double const variance = n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+  if (variance <= 0.0)
+    return 1.0;                         // All samples are equal.
+  double const z = (u - n1 * n2 / 2.0 - 0.5) / std::sqrt(variance);
+  return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// The samples of a set of benchmarks, stored as JSON:
+//
+//   {
+//     "format_version": 1,
+//     "label": "threadsafe 1a2b3c4",
+//     "host": "buildbot7",
+//     "benchmarks": {
+//       "AIReadWriteSpinLock rdlock": [ 12.5, 12.25, ... ],
+//       ...
+//     }
+//   }
+//
+// Only this format is read back; unknown keys are ignored.
+class Baseline
+{
+  public:
+    static constexpr int format_version = 1;
+
+    std::string m_label;
+    std::string m_host;
+    std::map<std::string, Samples> m_benchmarks;
+
+  private:
+    static void write_string(std::ostream& os, std::string const& str)
+    {
+      os << '"';
+      for (char c : str)
+      {
+        if (c == '"' || c == '\\')
+          os << '\\';
+        os << c;
+      }
+      os << '"';
+    }
+
+    // A minimal JSON reader for the format above.
+    class Parser
+    {
+      private:
+        std::string const& m_text;
+        size_t m_pos = 0;
+
+        [[noreturn]] void error(char const* what) const
+        {
+          throw std::runtime_error(std::string("JSON: ") + what + " at offset " + std::to_string(m_pos));
+        }
+
+      public:
+        Parser(std::string const& text) : m_text(text) { }
+
+        char peek()
+        {
+          while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+            ++m_pos;
+          return m_pos < m_text.size() ? m_text[m_pos] : '\0';
+        }
+
+        void expect(char c)
+        {
+          if (peek() != c)
+            error("unexpected character");
+          ++m_pos;
+        }
+
+        bool accept(char c)
+        {
+          if (peek() != c)
+            return false;
+          ++m_pos;
+          return true;
+        }
+
+        std::string string()
+        {
+          expect('"');
+          std::string result;
+          while (m_pos < m_text.size() && m_text[m_pos] != '"')
+          {
+            if (m_text[m_pos] == '\\' && ++m_pos == m_text.size())
+              break;
+            result += m_text[m_pos++];
+          }
+          expect('"');
+          return result;
+        }
+
+        double number()
+        {
+          peek();
+          size_t length;
+          double result;
+          try
+          {
+            result = std::stod(m_text.substr(m_pos, 32), &length);
+          }
+          catch (std::exception const&)
+          {
+            error("expected a number");
+          }
+          m_pos += length;
+          return result;
+        }
+
+        Samples array()
+        {
+          Samples result;
+          expect('[');
+          if (!accept(']'))
+          {
+            do
+              result.push_back(number());
+            while (accept(','));
+            expect(']');
+          }
+          return result;
+        }
+
+        // Skip a value of any type.
+        void skip()
+        {
+          char c = peek();
+          if (c == '"')
+            string();
+          else if (c == '[' || c == '{')
+          {
+            char const close = c == '[' ? ']' : '}';
+            ++m_pos;
+            if (accept(close))
+              return;
+            do
+            {
+              if (close == '}')
+              {
+                string();
+                expect(':');
+              }
+              skip();
+            }
+            while (accept(','));
+            expect(close);
+          }
+          else if (std::isalpha(static_cast<unsigned char>(c)))
+          {
+            while (std::isalpha(static_cast<unsigned char>(peek())))
+              ++m_pos;
+          }
+          else
+            number();
+        }
+    };
+
+  public:
+    // Throws std::runtime_error when the file can't be read or has another format.
+    void load(std::string const& path)
+    {
+      std::ifstream file(path);
+      if (!file)
+        throw std::runtime_error("Can't open " + path);
+      std::stringstream buffer;
+      buffer << file.rdbuf();
+      std::string const text = buffer.str();
+      Parser parser(text);
+      int version = 0;
+      parser.expect('{');
+      if (!parser.accept('}'))
+      {
+        do
+        {
+          std::string const key = parser.string();
+          parser.expect(':');
+          if (key == "format_version")
+            version = static_cast<int>(parser.number());
+          else if (key == "label")
+            m_label = parser.string();
+          else if (key == "host")
+            m_host = parser.string();
+          else if (key == "benchmarks")
+          {
+            parser.expect('{');
+            if (!parser.accept('}'))
+            {
+              do
+              {
+                std::string const name = parser.string();
+                parser.expect(':');
+                m_benchmarks[name] = parser.array();
+              }
+              while (parser.accept(','));
+              parser.expect('}');
+            }
+          }
+          else
+            parser.skip();
+        }
+        while (parser.accept(','));
+        parser.expect('}');
+      }
+      if (version != format_version)
+        throw std::runtime_error(path + " has format version " + std::to_string(version) + "; expected " + std::to_string(format_version));
+    }
+
+    void save(std::string const& path) const
+    {
+      std::ofstream file(path);
+      if (!file)
+        throw std::runtime_error("Can't write " + path);
+      file << "{\n  \"format_version\": " << format_version << ",\n  \"label\": ";
+      write_string(file, m_label);
+      file << ",\n  \"host\": ";
+      write_string(file, m_host);
+      file << ",\n  \"benchmarks\": {";
+      char const* separator = "\n";
+      for (auto const& [name, samples] : m_benchmarks)
+      {
+        file << separator << "    ";
+        write_string(file, name);
+        file << ": [";
+        for (size_t i = 0; i < samples.size(); ++i)
+          file << (i ? ", " : " ") << std::setprecision(6) << samples[i];
+        file << " ]";
+        separator = ",\n";
+      }
+      file << "\n  }\n}\n";
+      if (!file)
+        throw std::runtime_error("Error writing " + path);
+    }
+};
+
+} // namespace threadsafe::benchmark
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <sched.h>
+#include <unistd.h>
+
+namespace threadsafe {
+
+// Groups the CPUs of this machine into clusters of CPUs that share a last level
+// cache: an L3 slice (CCX), or, if there is no L3, a socket. It also knows which
+// CPUs are hardware threads (SMT siblings) of the same core, and the socket
+// (package) of every CPU.
+//
+// The topology is read once from /sys/devices/system/cpu. When that is not
+// available all CPUs end up in a single cluster, each on a core of its own, so
+// users must also work correctly (if not faster) on a machine with one cluster.
+class CpuTopology
+{
+  public:
+    // Ways to place the threads of a benchmark on CPUs; see placement().
+    enum Placement { packed, spread, same_core, same_cluster, across_packages, number_of_placements };
+    static constexpr std::array<char const*, number_of_placements> placement_names = { "packed", "spread", "same-core", "same-cluster", "across-packages" };
+
+  private:
+    std::vector<int> m_cluster_of_cpu;
+    std::vector<std::vector<int>> m_cpus_of_cluster;
+    std::vector<std::vector<int>> m_cpus_of_core;       // The hardware threads of every core.
+    std::vector<int> m_package_of_cpu;
+    int m_number_of_packages = 0;
+
+    static std::string read_line(std::string const& path)
+    {
+      std::ifstream file(path);
+      std::string line;
+      std::getline(file, line);
+      return line;
+    }
+
+    // Return a string that is the same for all CPUs that share a last level cache with cpu.
+    static std::string cluster_key(int cpu)
+    {
+      std::string const cpu_dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+      for (int index = 0;; ++index)
+      {
+        std::string const cache_dir = cpu_dir + "/cache/index" + std::to_string(index);
+        std::string const level = read_line(cache_dir + "/level");
+        if (level.empty())
+          break;
+        if (level == "3")
+          return "L3:" + read_line(cache_dir + "/shared_cpu_list");
+      }
+      return "package:" + read_line(cpu_dir + "/topology/physical_package_id");
+    }
+
+    // Return a string that is the same for all hardware threads of the core of cpu.
+    static std::string core_key(int cpu)
+    {
+      std::string const siblings = read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+      return siblings.empty() ? "cpu:" + std::to_string(cpu) : siblings;
+    }
+
+    CpuTopology()
+    {
+      int const number_of_cpus = std::max(1L, sysconf(_SC_NPROCESSORS_CONF));
+      std::map<std::string, int> clusters;
+      std::map<std::string, int> cores;
+      std::map<std::string, int> packages;
+      for (int cpu = 0; cpu < number_of_cpus; ++cpu)
+      {
+        auto [iter, inserted] = clusters.try_emplace(cluster_key(cpu), static_cast<int>(m_cpus_of_cluster.size()));
+        if (inserted)
+          m_cpus_of_cluster.emplace_back();
+        m_cluster_of_cpu.push_back(iter->second);
+        m_cpus_of_cluster[iter->second].push_back(cpu);
+        auto [core, new_core] = cores.try_emplace(core_key(cpu), static_cast<int>(m_cpus_of_core.size()));
+        if (new_core)
+          m_cpus_of_core.emplace_back();
+        m_cpus_of_core[core->second].push_back(cpu);
+        std::string const package_id = read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+        m_package_of_cpu.push_back(packages.try_emplace(package_id, static_cast<int>(packages.size())).first->second);
+      }
+      m_number_of_packages = packages.size();
+    }
+
+  public:
+    static CpuTopology const& instance()
+    {
+      static CpuTopology const s_topology;
+      return s_topology;
+    }
+
+    int number_of_cpus() const { return m_cluster_of_cpu.size(); }
+    int number_of_clusters() const { return m_cpus_of_cluster.size(); }
+    int number_of_cores() const { return m_cpus_of_core.size(); }
+    int number_of_packages() const { return m_number_of_packages; }
+
+    int cluster_of(int cpu) const { return cpu >= 0 && cpu < number_of_cpus() ? m_cluster_of_cpu[cpu] : 0; }
+    std::vector<int> const& cpus_of(int cluster) const { return m_cpus_of_cluster[cluster]; }
+    int package_of(int cpu) const { return cpu >= 0 && cpu < number_of_cpus() ? m_package_of_cpu[cpu] : 0; }
+
+    // Return the cluster of the CPU that the calling thread ran on when it first called this function.
+    // Threads that are not pinned to a CPU (or cluster) might have moved on since.
+    static int current_cluster()
+    {
+      thread_local int const t_cluster = instance().cluster_of(sched_getcpu());
+      return t_cluster;
+    }
+
+    // Pin the calling thread to cpu. Returns false if that failed.
+    static bool pin_current_thread(int cpu)
+    {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpu, &cpu_set);
+      return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+    }
+
+    // Parse a list of CPUs like "0-3,8,10-11", as used by taskset(1) and in /sys.
+    // Returns an empty list if the syntax is wrong.
+    static std::vector<int> parse_cpu_list(std::string const& list)
+    {
+      std::vector<int> cpus;
+      std::istringstream stream(list);
+      std::string range;
+      while (std::getline(stream, range, ','))
+      {
+        int first, last;
+        char dash;
+        std::istringstream range_stream(range);
+        if (!(range_stream >> first) || first < 0)
+          return {};
+        last = first;
+        if (range_stream >> dash && (dash != '-' || !(range_stream >> last) || last < first))
+          return {};
+        for (int cpu = first; cpu <= last; ++cpu)
+          cpus.push_back(cpu);
+      }
+      return cpus;
+    }
+
+    // Return the CPUs to pin at most max_cpus threads to, one thread per CPU, for the given placement:
+    //
+    //   packed          - Fill one core (all its hardware threads), then the next core of the same cluster, etc.
+    //   spread          - One thread per core, alternating between the packages and clusters; then the second hardware thread of every core, etc.
+    //   same-core       - The hardware threads of one core.
+    //   same-cluster    - Different cores of one cluster (sharing the L3).
+    //   across-packages - One thread per core, alternating between the packages (sockets).
+    //
+    // Only CPUs that the calling thread is allowed to run on are used.
+    // Returns an empty list when this machine has no two CPUs with the requested relation.
+    std::vector<int> placement(Placement placement, int max_cpus) const
+    {
+      cpu_set_t allowed;
+      CPU_ZERO(&allowed);
+      bool const have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+      // The usable hardware threads of every core, grouped per cluster.
+      std::vector<std::vector<std::vector<int>>> clusters(number_of_clusters());
+      for (std::vector<int> const& siblings : m_cpus_of_core)
+      {
+        std::vector<int> usable;
+        for (int cpu : siblings)
+          if (!have_mask || CPU_ISSET(cpu, &allowed))
+            usable.push_back(cpu);
+        if (!usable.empty())
+          clusters[cluster_of(usable[0])].push_back(usable);
+      }
+      std::erase_if(clusters, [](auto const& cores){ return cores.empty(); });
+      auto package = [this](std::vector<std::vector<int>> const& cores){ return package_of(cores[0][0]); };
+      std::stable_sort(clusters.begin(), clusters.end(), [&](auto const& c1, auto const& c2){ return package(c1) < package(c2); });
+
+      std::vector<int> cpus;
+      switch (placement)
+      {
+        case packed:
+          for (auto const& cores : clusters)
+            for (auto const& siblings : cores)
+              cpus.insert(cpus.end(), siblings.begin(), siblings.end());
+          break;
+        case spread:
+        {
+          // Interleave the clusters of different packages: cluster 0 of package 0, cluster 0 of package 1, cluster 1 of package 0, etc.
+          std::vector<int> index_in_package(clusters.size());
+          for (size_t c = 1; c < clusters.size(); ++c)
+            index_in_package[c] = package(clusters[c]) == package(clusters[c - 1]) ? index_in_package[c - 1] + 1 : 0;
+          std::vector<size_t> order(clusters.size());
+          for (size_t c = 0; c < order.size(); ++c)
+            order[c] = c;
+          std::stable_sort(order.begin(), order.end(), [&](size_t c1, size_t c2){ return index_in_package[c1] < index_in_package[c2]; });
+          for (size_t thread = 0;; ++thread)
+          {
+            size_t const size = cpus.size();
+            for (size_t core = 0;; ++core)
+            {
+              bool more_cores = false;
+              for (size_t c : order)
+                if (core < clusters[c].size())
+                {
+                  more_cores = true;
+                  if (thread < clusters[c][core].size())
+                    cpus.push_back(clusters[c][core][thread]);
+                }
+              if (!more_cores)
+                break;
+            }
+            if (cpus.size() == size)
+              break;
+          }
+          break;
+        }
+        case same_core:
+          for (auto const& cores : clusters)
+            for (auto const& siblings : cores)
+              if (cpus.empty() && siblings.size() >= 2)
+                cpus = siblings;
+          break;
+        case same_cluster:
+          for (auto const& cores : clusters)
+            if (cpus.empty() && cores.size() >= 2)
+              for (auto const& siblings : cores)
+                cpus.push_back(siblings[0]);
+          break;
+        case across_packages:
+        {
+          std::vector<std::vector<int>> packages;       // The first hardware thread of every core, per package.
+          for (auto const& cores : clusters)
+          {
+            if (packages.empty() || package_of(packages.back()[0]) != package(cores))
+              packages.emplace_back();
+            for (auto const& siblings : cores)
+              packages.back().push_back(siblings[0]);
+          }
+          if (packages.size() < 2)
+            break;
+          for (size_t core = 0;; ++core)
+          {
+            size_t const size = cpus.size();
+            for (auto const& cores : packages)
+              if (core < cores.size())
+                cpus.push_back(cores[core]);
+            if (cpus.size() == size)
+              break;
+          }
+          break;
+        }
+        case number_of_placements:
+          break;
+      }
+      if (cpus.size() > static_cast<size_t>(max_cpus))
+        cpus.resize(max_cpus);
+      return cpus;
+    }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "ThreadSlot.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+namespace threadsafe {
+
+// Epoch based reclamation.
+//
+// Threads pin the current epoch (see EpochDomain::Guard) for as long as they
+// dereference pointers to shared objects that another thread might unlink and
+// retire() at any moment. A retired object is deleted once the global epoch has
+// advanced twice since it was retired: at that point no thread can still be
+// pinned in an epoch in which it could have obtained a pointer to it. That is
+// checked by retire() and collect(), and by every collect_interval-th unpin()
+// of a thread while retired objects are pending, so that the objects retired
+// by the last writes are also deleted when nothing is retired after them.
+//
+// The global epoch can only advance when every pinned thread has announced the
+// current epoch. Pinning and unpinning only write to a per-thread record, so
+// readers never write to a cache line that is shared with other threads.
+//
+// Memory ordering: pin() stores the announced epoch and then executes a seq_cst
+// fence before the caller loads any protected pointer; try_advance() executes a
+// seq_cst fence before it reads the announced epochs. Hence, if try_advance()
+// does not see a pin, that pinned thread is guaranteed to see every unlink that
+// happened before the retire() of the object that is about to be freed. Also,
+// try_advance() reads the announced epochs with acquire, pairing with the release
+// store of unpin(), so that everything a thread did while it was pinned (like a
+// failed try-lock of an object) happens before that object is freed.
+class EpochDomain
+{
+  private:
+    struct alignas(cache_line_size) ThreadRecord
+    {
+      std::atomic<uint64_t> m_state{0};         // (epoch << 1) | 1 while pinned, 0 while not.
+      std::atomic<bool> m_in_use{true};         // False when the thread that owned this record exited.
+      unsigned int m_nesting{0};                // Only accessed by the owning thread.
+      unsigned int m_unpins{0};                 // Only accessed by the owning thread.
+      ThreadRecord* m_next{nullptr};            // Records are never freed; the list only grows.
+    };
+
+    struct Retired
+    {
+      void* m_ptr;
+      void (*m_deleter)(void*);
+      size_t m_size;
+      uint64_t m_epoch;
+    };
+
+    alignas(cache_line_size) std::atomic<uint64_t> m_global_epoch{1};
+    alignas(cache_line_size) std::atomic<ThreadRecord*> m_records{nullptr};
+    std::mutex m_retired_mutex;
+    std::vector<Retired> m_retired;             // Protected by m_retired_mutex.
+    std::atomic<size_t> m_pending_objects{0};
+    std::atomic<size_t> m_pending_bytes{0};
+
+    // Releases the record of a thread when it exits.
+    struct ThreadRecordHolder
+    {
+      ThreadRecord* m_record{nullptr};
+      ~ThreadRecordHolder() { if (m_record) m_record->m_in_use.store(false, std::memory_order_release); }
+    };
+
+    ThreadRecord* acquire_record()
+    {
+      // Reuse the record of a thread that exited, if any.
+      for (ThreadRecord* record = m_records.load(std::memory_order_acquire); record; record = record->m_next)
+      {
+        bool in_use = false;
+        if (!record->m_in_use.load(std::memory_order_relaxed) &&
+            record->m_in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+          return record;
+      }
+      ThreadRecord* record = new ThreadRecord;
+      ThreadRecord* head = m_records.load(std::memory_order_relaxed);
+      do
+        record->m_next = head;
+      while (!m_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+      return record;
+    }
+
+    ThreadRecord& thread_record()
+    {
+      thread_local ThreadRecordHolder t_holder;
+      if (__builtin_expect(!t_holder.m_record, false))
+        t_holder.m_record = acquire_record();
+      return *t_holder.m_record;
+    }
+
+    EpochDomain() = default;
+
+  public:
+    // How often (in outermost unpins per thread) unpin() tries to reclaim pending objects.
+    static constexpr unsigned int collect_interval = 256;
+
+    // There is one domain per process.
+    static EpochDomain& instance()
+    {
+      static EpochDomain s_domain;
+      return s_domain;
+    }
+
+    void pin()
+    {
+      ThreadRecord& record(thread_record());
+      if (record.m_nesting++ == 0)
+      {
+        uint64_t epoch = m_global_epoch.load(std::memory_order_relaxed);
+        record.m_state.store((epoch << 1) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+      }
+    }
+
+    void unpin()
+    {
+      ThreadRecord& record(thread_record());
+      assert(record.m_nesting > 0);
+      if (--record.m_nesting == 0)
+      {
+        record.m_state.store(0, std::memory_order_release);
+        if (++record.m_unpins % collect_interval == 0 && m_pending_objects.load(std::memory_order_relaxed) != 0) [[unlikely]]
+        {
+          try_advance();
+          collect();
+        }
+      }
+    }
+
+    bool is_pinned() { return thread_record().m_nesting > 0; }
+
+    // RAII pin.
+    class Guard
+    {
+      private:
+        EpochDomain& m_domain;
+
+      public:
+        Guard() : m_domain(instance()) { m_domain.pin(); }
+        ~Guard() { m_domain.unpin(); }
+
+        Guard(Guard const&) = delete;
+        Guard& operator=(Guard const&) = delete;
+    };
+
+    // Advance the global epoch if every pinned thread announced the current one.
+    bool try_advance()
+    {
+      uint64_t epoch = m_global_epoch.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (ThreadRecord* record = m_records.load(std::memory_order_acquire); record; record = record->m_next)
+      {
+        uint64_t state = record->m_state.load(std::memory_order_acquire);
+        if ((state & 1) && (state >> 1) != epoch)
+          return false;
+      }
+      return m_global_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    // Delete ptr, using deleter, once no thread can still be using it.
+    // ptr must already be unreachable for threads that pin the epoch from now on.
+    void retire(void* ptr, void (*deleter)(void*), size_t size = 0)
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_retired_mutex);
+        m_retired.push_back({ ptr, deleter, size, m_global_epoch.load(std::memory_order_seq_cst) });
+      }
+      m_pending_objects.fetch_add(1, std::memory_order_relaxed);
+      m_pending_bytes.fetch_add(size, std::memory_order_relaxed);
+      try_advance();
+      collect();
+    }
+
+    template<typename T>
+    void retire(T* ptr)
+    {
+      retire(const_cast<void*>(static_cast<void const*>(ptr)), [](void* p){ delete static_cast<T*>(p); }, sizeof(T));
+    }
+
+    // Delete all retired objects that are no longer in use.
+    void collect()
+    {
+      std::vector<Retired> reclaimable;
+      {
+        std::lock_guard<std::mutex> lk(m_retired_mutex);
+        uint64_t epoch = m_global_epoch.load(std::memory_order_acquire);
+        auto keep = m_retired.begin();
+        for (auto it = m_retired.begin(); it != m_retired.end(); ++it)
+        {
+          if (it->m_epoch + 2 <= epoch)
+            reclaimable.push_back(*it);
+          else
+            *keep++ = *it;
+        }
+        m_retired.erase(keep, m_retired.end());
+      }
+      for (Retired const& retired : reclaimable)
+      {
+        retired.m_deleter(retired.m_ptr);
+        m_pending_objects.fetch_sub(1, std::memory_order_relaxed);
+        m_pending_bytes.fetch_sub(retired.m_size, std::memory_order_relaxed);
+      }
+    }
+
+    // Wait until every thread that is pinned at the moment of the call has unpinned.
+    // The calling thread may not be pinned itself.
+    void synchronize()
+    {
+      assert(!is_pinned());
+      uint64_t target = m_global_epoch.load(std::memory_order_seq_cst) + 2;
+      while (m_global_epoch.load(std::memory_order_acquire) < target)
+        if (!try_advance())
+          std::this_thread::yield();
+    }
+
+    // The number of retired objects, and their total size, that were not deleted yet.
+    size_t pending_objects() const { return m_pending_objects.load(std::memory_order_relaxed); }
+    size_t pending_bytes() const { return m_pending_bytes.load(std::memory_order_relaxed); }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "EpochDomain.h"
+#include "ThreadSlot.h"
+#include "TryAccess.h"
+#include "Backoff.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+
+namespace threadsafe {
+namespace detail {
+
+// The location of a tracked object, shared between the object and its trackers.
+//
+// Slots are never freed; when the tracked object is destroyed its slot gets a new
+// generation and is reused for another object. Hence an EpochTracker never has to
+// keep its slot alive, it only has to check the generation.
+struct alignas(cache_line_size) TrackerSlot
+{
+  std::atomic<uint64_t> m_generation{0};
+  std::atomic<void*> m_tracked{nullptr};
+  std::atomic<bool> m_resolved{false};          // Set when a tracker looked up the object.
+
+  static TrackerSlot* allocate(void* tracked)
+  {
+    TrackerSlot* slot;
+    {
+      std::lock_guard<std::mutex> lk(free_slots_mutex());
+      std::vector<TrackerSlot*>& free_slots(free_slots_list());
+      if (free_slots.empty())
+        slot = new TrackerSlot;
+      else
+      {
+        slot = free_slots.back();
+        free_slots.pop_back();
+      }
+    }
+    slot->m_resolved.store(false, std::memory_order_relaxed);
+    slot->m_tracked.store(tracked, std::memory_order_release);
+    return slot;
+  }
+
+  // Only call this when no thread can be resolving the slot anymore.
+  void release()
+  {
+    std::lock_guard<std::mutex> lk(free_slots_mutex());
+    free_slots_list().push_back(this);
+  }
+
+  static std::mutex& free_slots_mutex() { static std::mutex s_mutex; return s_mutex; }
+  // Never destroyed; trackers might still be used during static destruction.
+  static std::vector<TrackerSlot*>& free_slots_list() { static std::vector<TrackerSlot*>* s_list = new std::vector<TrackerSlot*>; return *s_list; }
+};
+
+} // namespace detail
+
+template<typename T, typename POLICY> class EpochTracker;
+
+// A tracked object that can be found through an EpochTracker without touching
+// any reference count.
+//
+//   using TFoo = EpochTrackedObject<locked_TFoo, policy::ReadWrite<AIFutexReadWriteMutex>>;
+//   TFoo tfoo;
+//   EpochTracker tracker(tfoo);
+//   TFoo tfoo2(std::move(tfoo));
+//   {
+//     auto tfoo_w = tracker.tracked_wat();     // Refers to tfoo2.
+//     if (tfoo_w)
+//       tfoo_w->x = 42;
+//   }
+//
+// This is the counterpart of UnlockedTrackedObject / ObjectTracker, where getting
+// access through a std::weak_ptr<ObjectTracker> costs a promotion to std::shared_ptr.
+// Here the lookup pins the epoch (a store to a thread local cache line), loads the
+// current address of the object, try-locks it and checks that the address didn't
+// change while it was locking; readers share nothing but the lock of the object.
+// If the object is locked, the lookup unpins and backs off before it tries again:
+// a thread never waits for a lock while it is pinned (unless it was already pinned
+// before the lookup, by something else). Once obtained, the access
+// object does not keep the thread pinned. POLICY must therefore be supported by
+// TryAccess (see TryAccess.h).
+//
+// The price is paid by the object: moving or destroying it write locks it (like
+// UnlockedTrackedObject) and, once a tracker looked it up, the destructor of every
+// (moved-from) object waits for an epoch grace period, so that no tracker can still
+// be about to lock it. Therefore, it may not be destroyed by a thread that is
+// pinned by something else, like a crat of an Unlocked<T, policy::RCU>; holding
+// the lock of another (tracked) object while destroying it is fine.
+template<typename T, typename POLICY>
+class EpochTrackedObject : public Unlocked<T, POLICY>
+{
+  public:
+    using unlocked_type = Unlocked<T, POLICY>;
+
+  private:
+    friend class EpochTracker<T, POLICY>;
+    detail::TrackerSlot* m_slot;
+    bool m_needs_grace_period = false;          // A tracker might have seen our address.
+
+    // Return true if a tracker might have loaded our address. Must be called after changing m_tracked.
+    bool was_resolved() const
+    {
+      // Pairs with the fence in the constructor of TrackedAccess.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      return m_slot->m_resolved.load(std::memory_order_relaxed);
+    }
+
+    // Called with orig write locked; see the move constructor.
+    EpochTrackedObject(EpochTrackedObject&& orig, typename unlocked_type::wat&& orig_w) :
+      unlocked_type(std::move(*orig_w)), m_slot(std::exchange(orig.m_slot, nullptr))
+    {
+      m_slot->m_tracked.store(this, std::memory_order_release);
+      orig.m_needs_grace_period = was_resolved();
+    }
+
+  public:
+    template<typename... ARGS>
+      requires (!(sizeof...(ARGS) == 1 && (std::is_same_v<std::remove_cvref_t<ARGS>, EpochTrackedObject> && ...)))
+    EpochTrackedObject(ARGS&&... args) : unlocked_type(std::forward<ARGS>(args)...), m_slot(detail::TrackerSlot::allocate(this)) { }
+
+    // Keeps orig write locked until it is no longer tracked.
+    EpochTrackedObject(EpochTrackedObject&& orig) : EpochTrackedObject(std::move(orig), typename unlocked_type::wat(orig)) { }
+
+    ~EpochTrackedObject()
+    {
+      if (m_slot)
+      {
+        {
+          // Wait for trackers that are accessing us.
+          typename unlocked_type::wat this_w(*this);
+          m_slot->m_tracked.store(nullptr, std::memory_order_relaxed);
+          m_slot->m_generation.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_needs_grace_period = was_resolved();
+      }
+      if (m_needs_grace_period)
+        EpochDomain::instance().synchronize();
+      if (m_slot)
+        m_slot->release();
+    }
+};
+
+// Access to a tracked object that was obtained through an EpochTracker.
+// Converts to false when the object no longer exists.
+template<typename TRACKED, bool writable>
+class TrackedAccess
+{
+  private:
+    std::optional<TryAccess<typename TRACKED::unlocked_type, writable>> m_access;
+
+  public:
+    TrackedAccess(detail::TrackerSlot* slot, uint64_t generation)
+    {
+      // Flag the slot before pinning, so that the fence in pin() separates this from loading the
+      // address. Either EpochTrackedObject::was_resolved, after changing the address, sees the flag,
+      // or we see the new address.
+      if (!slot->m_resolved.load(std::memory_order_relaxed))
+        slot->m_resolved.store(true, std::memory_order_relaxed);
+      bool const nested = EpochDomain::instance().is_pinned();
+      backoff::SpinThenPark<> backoff;
+      for (;;)
+      {
+        {
+          EpochDomain::Guard pin;
+          if (nested)   // Then pin() didn't execute a fence.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+          if (slot->m_generation.load(std::memory_order_acquire) != generation)
+            return;
+          TRACKED* tracked = static_cast<TRACKED*>(slot->m_tracked.load(std::memory_order_acquire));
+          if (!tracked)
+            return;
+          // Never block while pinned: a thread that holds this lock might be waiting in
+          // the destructor of another EpochTrackedObject for us to unpin.
+          m_access.emplace(*tracked);
+          if (*m_access)
+          {
+            // Once we hold the lock the object can't be moved or destroyed anymore; check that it wasn't already.
+            if (slot->m_tracked.load(std::memory_order_acquire) == tracked)
+              return;
+            m_access.reset();
+            continue;   // It was moved; look it up again right away.
+          }
+          m_access.reset();
+        }
+        // Locked by another thread; wait unpinned, then look the object up again.
+        if (!backoff.pause())
+          std::this_thread::yield();
+      }
+    }
+
+    explicit operator bool() const { return m_access.has_value(); }
+    auto operator->() const { return m_access->operator->(); }
+    auto& operator*() const { return **m_access; }
+};
+
+// Finds an EpochTrackedObject wherever it was moved to.
+// Trackers can be copied freely; they do not keep anything alive.
+template<typename T, typename POLICY>
+class EpochTracker
+{
+  public:
+    using tracked_type = EpochTrackedObject<T, POLICY>;
+    using unlocked_type = typename tracked_type::unlocked_type;
+
+  private:
+    detail::TrackerSlot* m_slot;
+    uint64_t m_generation;
+
+  public:
+    EpochTracker(EpochTrackedObject<T, POLICY> const& tracked) :
+      m_slot(tracked.m_slot), m_generation(m_slot->m_generation.load(std::memory_order_relaxed)) { }
+
+    TrackedAccess<tracked_type, false> tracked_crat() const { return { m_slot, m_generation }; }
+    TrackedAccess<tracked_type, false> tracked_rat() const { return { m_slot, m_generation }; }
+    TrackedAccess<tracked_type, true> tracked_wat() const { return { m_slot, m_generation }; }
+};
+
+} // namespace threadsafe
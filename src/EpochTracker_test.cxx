@@ -0,0 +1,189 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "AIFutexReadWriteMutex.h"
+#include "EpochTracker.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// EpochTracker: lookups follow the object when it is moved and fail once it is
+// destroyed, also while another thread keeps moving it around. Then compares
+// the lookup throughput with that of promoting a std::weak_ptr.
+
+using namespace threadsafe;
+
+int const number_of_threads = std::max(2U, std::thread::hardware_concurrency());
+int constexpr ops = 1000000;
+
+struct locked_TFoo
+{
+  long x = 0;
+};
+
+using policy_type = policy::ReadWrite<AIFutexReadWriteMutex>;
+using TFoo = EpochTrackedObject<locked_TFoo, policy_type>;
+using TFooTracker = EpochTracker<locked_TFoo, policy_type>;
+
+void test_moves()
+{
+  std::optional<TFoo> tfoo(std::in_place);
+  TFooTracker tracker(*tfoo);
+  {
+    auto tfoo_w = tracker.tracked_wat();
+    assert(tfoo_w);
+    tfoo_w->x = 1234;
+  }
+  std::optional<TFoo> tfoo2(std::in_place, std::move(*tfoo));
+  tfoo.reset();
+  {
+    auto tfoo_r = tracker.tracked_crat();
+    assert(tfoo_r && tfoo_r->x == 1234);
+    assert(&*tfoo_r == &*TFoo::crat(*tfoo2));
+  }
+  tfoo2.reset();
+  assert(!tracker.tracked_crat());
+  // The slot of the destroyed object is reused, but the old tracker must not find the new object.
+  TFoo tfoo3;
+  assert(!tracker.tracked_wat());
+  assert(TFooTracker(tfoo3).tracked_wat());
+  std::cout << "Moves and destruction: Success!" << std::endl;
+}
+
+// Readers increment x through a tracker while the object is moved back and forth.
+void test_concurrent_moves()
+{
+  std::optional<TFoo> storage[2];
+  storage[0].emplace();
+  TFooTracker const tracker(*storage[0]);
+  std::atomic<bool> stop{false};
+  std::atomic<long> increments{0};
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < number_of_threads; ++t)
+    readers.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      long n = 0;
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        auto tfoo_w = tracker.tracked_wat();
+        assert(tfoo_w);
+        ++tfoo_w->x;
+        ++n;
+      }
+      increments += n;
+    });
+  int moves = 0;
+  for (auto start = std::chrono::steady_clock::now(); std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500); ++moves)
+  {
+    int from = moves % 2;
+    storage[1 - from].emplace(std::move(*storage[from]));
+    storage[from].reset();
+  }
+  stop = true;
+  for (auto& thread : readers)
+    thread.join();
+  long x = TFoo::crat(*storage[moves % 2])->x;
+  assert(x == increments);
+  std::cout << "Concurrent moves (" << moves << " moves, " << increments << " increments): " << (x == increments ? "Success!" : "FAILED!") << std::endl;
+}
+
+// A thread that holds the lock of y destroys x, which was looked up before, while
+// another thread is looking up y. The destructor of x waits for that thread to
+// unpin, which it does while it backs off.
+void test_destroy_while_locked()
+{
+  TFoo y;
+  TFooTracker const y_tracker(y);
+  std::optional<TFoo> x(std::in_place);
+  assert(TFooTracker(*x).tracked_crat());
+  std::atomic<bool> looking_up{false};
+  std::thread other;
+  {
+    TFoo::wat y_w(y);
+    other = std::thread([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      looking_up = true;
+      auto y_r = y_tracker.tracked_rat();
+      assert(y_r && y_r->x == 1);
+    });
+    while (!looking_up)
+      std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    TFoo moved(std::move(*x));
+    x.reset();                                  // The moved-from x needs a grace period.
+    y_w->x = 1;
+  }                                             // Destroys moved (idem) before releasing y.
+  other.join();
+  std::cout << "Destruction while holding another lock: Success!" << std::endl;
+}
+
+using UnlockedFoo = Unlocked<locked_TFoo, policy_type>;
+thread_local long volatile sink;
+
+double weak_ptr_lookups(int threads)
+{
+  auto foo = std::make_shared<UnlockedFoo>();
+  std::weak_ptr<UnlockedFoo> const weak_foo = foo;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops; ++i)
+      {
+        auto locked_foo = weak_foo.lock();
+        UnlockedFoo::crat foo_r(*locked_foo);
+        sink = foo_r->x;
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  return threads * ops / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+}
+
+double tracker_lookups(int threads)
+{
+  TFoo tfoo;
+  TFooTracker const tracker(tfoo);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops; ++i)
+      {
+        auto tfoo_r = tracker.tracked_crat();
+        sink = tfoo_r->x;
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  return threads * ops / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_moves();
+  test_concurrent_moves();
+  test_destroy_while_locked();
+
+  std::cout << "Million lookups + crat per second:" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(16) << "weak_ptr::lock" << std::setw(16) << "EpochTracker" << std::endl;
+  for (int threads = 1; threads <= number_of_threads; threads *= 2)
+  {
+    double promoted = weak_ptr_lookups(threads);
+    double tracked = tracker_lookups(threads);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2) << std::setw(16) << promoted << std::setw(16) << tracked << std::endl;
+  }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "ThreadSlot.h"
+#include "Backoff.h"
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+namespace threadsafe {
+namespace policy {
+
+// Flat combining policy for small objects that many threads write to.
+//
+// Unlocked<T, policy::FlatCombining> has, besides crat and wat, a member function
+//
+//   foo.apply([](Foo& foo){ foo.count += 1; });
+//
+// that publishes the operation in a per-thread slot and then waits until it has
+// been executed. Whichever thread obtains the lock executes all operations that
+// are published at that moment, in one batch, so that under contention the lock
+// and T stay in the cache of one CPU instead of moving to the next thread for
+// every operation. apply() returns after the operation was executed, by the
+// calling thread or by another one; results can be passed back through a
+// captured reference. Operations must not throw and may not access the same
+// object again.
+//
+// crat and wat obtain the lock like a Primitive; there is no rat to wat
+// conversion; rat is the same as crat. Every object has number_of_slots cache
+// lines for the published operations; threads whose slot (thread_slot() modulo
+// number_of_slots) is in use by another thread obtain the lock themselves.
+struct FlatCombining
+{
+  static constexpr unsigned int number_of_slots = 64;
+  static constexpr int max_passes = 3;          // Scan the slots at most this often per batch.
+};
+
+} // namespace policy
+
+template<typename T>
+class Unlocked<T, policy::FlatCombining>
+{
+  public:
+    using data_type = T;
+    using policy_type = policy::FlatCombining;
+
+  private:
+    // A published operation; lives on the stack of the thread that called apply().
+    struct Request
+    {
+      void (*m_invoke)(void* op, T& data);
+      void* m_op;
+      std::atomic<bool> m_done{false};
+    };
+
+    struct alignas(cache_line_size) Slot
+    {
+      std::atomic<Request*> m_request{nullptr};
+    };
+
+    alignas(cache_line_size) mutable std::atomic<bool> m_locked{false};
+    T m_data;                                                       // Only accessed with m_locked set.
+    alignas(cache_line_size) std::atomic<unsigned int> m_used_slots{0};   // One more than the highest slot index that was ever used.
+    std::unique_ptr<Slot[]> m_slots;
+
+    bool try_lock() const
+    {
+      return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void lock() const
+    {
+      backoff::SpinThenPark<> backoff;
+      while (!try_lock())
+        if (!backoff.pause())
+        {
+          std::this_thread::yield();
+          backoff.reset();
+        }
+    }
+
+    void unlock() const
+    {
+      m_locked.store(false, std::memory_order_release);
+    }
+
+    // Execute all published operations. Must be called with the lock held.
+    void combine()
+    {
+      unsigned int const used_slots = m_used_slots.load(std::memory_order_relaxed);
+      for (int pass = 0; pass < policy_type::max_passes; ++pass)
+      {
+        bool found = false;
+        for (unsigned int i = 0; i < used_slots; ++i)
+        {
+          Request* request = m_slots[i].m_request.load(std::memory_order_acquire);
+          if (!request)
+            continue;
+          request->m_invoke(request->m_op, m_data);
+          m_slots[i].m_request.store(nullptr, std::memory_order_relaxed);
+          // The request may be gone as soon as it is marked done.
+          request->m_done.store(true, std::memory_order_release);
+          found = true;
+        }
+        if (!found)
+          break;
+      }
+    }
+
+  public:
+    class crat
+    {
+      private:
+        Unlocked const* m_unlocked;
+
+      public:
+        explicit crat(Unlocked const& unlocked) : m_unlocked(&unlocked)
+        {
+          m_unlocked->lock();
+        }
+
+        ~crat()
+        {
+          m_unlocked->unlock();
+        }
+
+        crat(crat const&) = delete;
+        crat& operator=(crat const&) = delete;
+
+        T const* operator->() const { return &m_unlocked->m_data; }
+        T const& operator*() const { return m_unlocked->m_data; }
+    };
+
+    using rat = crat;
+
+    class wat
+    {
+      private:
+        Unlocked* m_unlocked;
+
+      public:
+        explicit wat(Unlocked& unlocked) : m_unlocked(&unlocked)
+        {
+          m_unlocked->lock();
+        }
+
+        ~wat()
+        {
+          m_unlocked->unlock();
+        }
+
+        wat(wat const&) = delete;
+        wat& operator=(wat const&) = delete;
+
+        T* operator->() const { return &m_unlocked->m_data; }
+        T& operator*() const { return m_unlocked->m_data; }
+    };
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) :
+      m_data(std::forward<ARGS>(args)...), m_slots(std::make_unique<Slot[]>(policy_type::number_of_slots)) { }
+
+    Unlocked(Unlocked const&) = delete;
+    Unlocked& operator=(Unlocked const&) = delete;
+
+    // Execute op(T&) while holding the lock, possibly by another thread.
+    template<typename OP>
+    void apply(OP&& op)
+    {
+      // Uncontended, don't bother publishing.
+      if (try_lock())
+      {
+        op(m_data);
+        combine();
+        unlock();
+        return;
+      }
+      Request request{[](void* op, T& data){ (*static_cast<std::remove_reference_t<OP>*>(op))(data); },
+        const_cast<std::remove_cvref_t<OP>*>(std::addressof(op))};
+      unsigned int const slot_index = thread_slot() % policy_type::number_of_slots;
+      unsigned int used_slots = m_used_slots.load(std::memory_order_relaxed);
+      while (used_slots <= slot_index && !m_used_slots.compare_exchange_weak(used_slots, slot_index + 1, std::memory_order_relaxed))
+        ;
+      std::atomic<Request*>& slot = m_slots[slot_index].m_request;
+      Request* expected = nullptr;
+      if (slot.load(std::memory_order_relaxed) || !slot.compare_exchange_strong(expected, &request, std::memory_order_release, std::memory_order_relaxed))
+      {
+        // The slot is used by another thread.
+        lock();
+        op(m_data);
+        combine();
+        unlock();
+        return;
+      }
+      backoff::SpinThenPark<> backoff;
+      while (!request.m_done.load(std::memory_order_acquire))
+      {
+        if (try_lock())
+        {
+          combine();
+          unlock();
+          // We published before obtaining the lock; combine() executed our request.
+          continue;
+        }
+        if (!backoff.pause())
+        {
+          std::this_thread::yield();
+          backoff.reset();
+        }
+      }
+    }
+};
+
+} // namespace threadsafe
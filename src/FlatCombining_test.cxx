@@ -0,0 +1,135 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "FlatCombining.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Many threads doing a short write on the same counter (the add() of
+// AIReadWriteSpinLock_test.cxx): Unlocked<Counter, policy::FlatCombining>::apply
+// versus a wat on Primitive<std::mutex> and on ReadWrite<AIReadWriteSpinLock>.
+// Prints the throughput at increasing thread counts and checks the final count.
+
+using namespace threadsafe;
+
+int const max_threads = std::max(32U, std::thread::hardware_concurrency());
+int constexpr ops = 200000;
+
+struct Counter
+{
+  long count = 0;
+  long sum = 0;
+};
+
+using unlocked_Counter_mutex_t = Unlocked<Counter, policy::Primitive<std::mutex>>;
+using unlocked_Counter_spin_t = Unlocked<Counter, policy::ReadWrite<AIReadWriteSpinLock>>;
+using unlocked_Counter_combining_t = Unlocked<Counter, policy::FlatCombining>;
+
+inline void add(Counter& counter, long d)
+{
+  ++counter.count;
+  counter.sum += d;
+}
+
+template<typename UNLOCKED>
+void write(UNLOCKED& counter, long d)
+{
+  if constexpr (std::is_same_v<typename UNLOCKED::policy_type, policy::FlatCombining>)
+    counter.apply([d](Counter& counter){ add(counter, d); });
+  else
+  {
+    typename UNLOCKED::wat counter_w(counter);
+    add(*counter_w, d);
+  }
+}
+
+// Returns millions of writes per second.
+template<typename UNLOCKED>
+double run(int threads)
+{
+  UNLOCKED counter;
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      ++ready;
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      for (int i = 0; i < ops; ++i)
+        write(counter, t);
+    });
+  while (ready != threads)
+    std::this_thread::yield();
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : thread_pool)
+    thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  typename UNLOCKED::crat counter_r(counter);
+  assert(counter_r->count == static_cast<long>(threads) * ops);
+  assert(counter_r->sum == static_cast<long>(threads - 1) * threads / 2 * ops);
+  return static_cast<double>(threads) * ops / seconds / 1e6;
+}
+
+// A thread that holds a wat while others call apply(); and apply() from many threads
+// while one thread only reads.
+void test_mixed()
+{
+  unlocked_Counter_combining_t counter;
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < 8; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops / 10; ++i)
+      {
+        if (t == 0 && i % 100 == 0)
+        {
+          unlocked_Counter_combining_t::wat counter_w(counter);
+          add(*counter_w, 1);
+        }
+        else if (t == 1)
+        {
+          unlocked_Counter_combining_t::crat counter_r(counter);
+          assert(counter_r->count <= counter_r->sum + 8L * ops);
+        }
+        else
+          counter.apply([](Counter& counter){ add(counter, 1); });
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  unlocked_Counter_combining_t::crat counter_r(counter);
+  long const expected = 7L * (ops / 10);        // Every thread but the reader.
+  std::cout << "Mixed apply, crat and wat: " << (counter_r->count == expected && counter_r->sum == expected ? "Success!" : "FAILED!") << std::endl;
+  assert(counter_r->count == expected);
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_mixed();
+
+  std::cout << "Million writes per second:" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(24) << "Primitive<std::mutex>" << std::setw(24) << "AIReadWriteSpinLock" <<
+    std::setw(16) << "FlatCombining" << std::endl;
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    double mutex = run<unlocked_Counter_mutex_t>(threads);
+    double spin = run<unlocked_Counter_spin_t>(threads);
+    double combining = run<unlocked_Counter_combining_t>(threads);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2) << std::setw(24) << mutex << std::setw(24) << spin <<
+      std::setw(16) << combining << std::endl;
+  }
+}
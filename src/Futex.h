@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <type_traits>
+#include <cerrno>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace threadsafe::futex {
+
+// Thin wrappers around the Linux futex system call.
+//
+// All waits use FUTEX_WAIT_BITSET so that different kinds of waiters on the
+// same word (for example readers and writers) can be woken up selectively.
+// Only process-private futexes are used.
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "std::atomic<uint32_t> must be usable as futex word.");
+
+constexpr uint32_t any = FUTEX_BITSET_MATCH_ANY;
+
+// Block as long as *word == expected, until woken up with a bitset that has
+// a bit in common with bitset, or until the absolute CLOCK_MONOTONIC time
+// deadline (if not null) passed.
+// Returns 0 when woken up by wake(), otherwise EAGAIN (*word != expected),
+// EINTR or ETIMEDOUT.
+inline int wait(std::atomic<uint32_t>& word, uint32_t expected, uint32_t bitset = any, timespec const* deadline = nullptr)
+{
+  long res = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, expected, deadline, nullptr, bitset);
+  return res == 0 ? 0 : errno;
+}
+
+// Wake up at most count threads that are waiting on word with a bitset that
+// has a bit in common with bitset. Returns the number of woken threads.
+inline int wake(std::atomic<uint32_t>& word, int count = INT_MAX, uint32_t bitset = any)
+{
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_BITSET | FUTEX_PRIVATE_FLAG, count, nullptr, nullptr, bitset);
+}
+
+// Convert deadline into a std::chrono::steady_clock time point.
+template<typename CLOCK, typename DURATION>
+std::chrono::steady_clock::time_point steady_deadline(std::chrono::time_point<CLOCK, DURATION> const& deadline)
+{
+  using namespace std::chrono;
+  if constexpr (std::is_same_v<CLOCK, steady_clock>)
+    return time_point_cast<steady_clock::duration>(deadline);
+  else
+    return steady_clock::now() + duration_cast<steady_clock::duration>(deadline - CLOCK::now());
+}
+
+// Convert deadline into the absolute CLOCK_MONOTONIC time that wait() expects
+// (std::chrono::steady_clock is CLOCK_MONOTONIC).
+template<typename CLOCK, typename DURATION>
+timespec monotonic_deadline(std::chrono::time_point<CLOCK, DURATION> const& deadline)
+{
+  using namespace std::chrono;
+  long long ns = std::max(0LL, static_cast<long long>(duration_cast<nanoseconds>(steady_deadline(deadline).time_since_epoch()).count()));
+  return { static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) };
+}
+
+} // namespace threadsafe::futex
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "LockStatistics.h"
+#include "UnlockedAccessor.h"
+
+#include <bit>
+#include <utility>
+#include <cstdint>
+
+namespace threadsafe {
+namespace policy {
+
+// Policy decorator that records, per Unlocked object, how often and how long
+// crat, rat and wat had to wait for the lock and how long they held it.
+//
+//   Unlocked<Foo, policy::Instrumented<policy::ReadWrite<AIReadWriteMutex>>> foo;
+//   foo.statistics().set_name("foo");
+//   ...
+//   LockStatisticsRegistry::instance().dump(std::cout);
+//
+// POLICY can be any policy that can be used with Unlocked (OneThread, Primitive,
+// ReadWrite, ...); locking itself is left entirely to Unlocked<T, POLICY>.
+// Each instance carries a LockStatistics (about 4 kB, plus 2 kB per thread that used it).
+//
+// Only one in sample_interval (a power of two) accesses, picked at random per
+// thread, is measured; it is recorded with a weight of sample_interval, so all
+// counts and times are estimates. The other accesses cost a few instructions.
+// A sampled access is counted as contended when the lock is not free just before
+// it is taken: that is tested by taking and releasing it with try_lock() (Primitive)
+// or try_rdlock() / try_wrlock() (ReadWrite), where the mutex has those. Otherwise,
+// and for the conversion of a rat into a wat, a wait of more than
+// LockStatistics::contended_ticks counts as contended.
+template<typename POLICY, unsigned int sample_interval = 64>
+struct Instrumented
+{
+  static_assert(std::has_single_bit(sample_interval), "sample_interval must be a power of two.");
+  using policy_type = POLICY;
+};
+
+} // namespace policy
+
+namespace detail {
+
+// Return true for a random one in sample_interval calls of this thread.
+template<unsigned int sample_interval>
+bool sample_access()
+{
+  if constexpr (sample_interval == 1)
+    return true;
+  else
+  {
+    // xorshift32; seeded differently per thread and never zero.
+    thread_local uint32_t t_state = (thread_slot() + 1) * 0x9e3779b9U;
+    t_state ^= t_state << 13;
+    t_state ^= t_state >> 17;
+    t_state ^= t_state << 5;
+    return (t_state & (sample_interval - 1)) == 0;
+  }
+}
+
+enum class LockProbe { free, locked, unknown };
+
+// Whether the lock of an Unlocked<T, POLICY> is free at this moment.
+template<typename POLICY>
+struct ContentionProbe
+{
+  template<bool writable, typename UNLOCKED>
+  static LockProbe probe(UNLOCKED const&) { return LockProbe::unknown; }
+};
+
+template<>
+struct ContentionProbe<policy::OneThread>
+{
+  template<bool writable, typename UNLOCKED>
+  static LockProbe probe(UNLOCKED const&) { return LockProbe::free; }
+};
+
+// Primitive only has an exclusive lock.
+template<typename MUTEX>
+struct ContentionProbe<policy::Primitive<MUTEX>>
+{
+  template<bool writable, typename UNLOCKED>
+  static LockProbe probe(UNLOCKED const& unlocked)
+  {
+    if constexpr (requires (MUTEX& mutex) { mutex.try_lock(); })
+    {
+      auto& mutex = UnlockedAccessor<UNLOCKED>::get_mutex(unlocked);
+      if (!mutex.try_lock())
+        return LockProbe::locked;
+      mutex.unlock();
+      return LockProbe::free;
+    }
+    else
+      return LockProbe::unknown;
+  }
+};
+
+template<typename MUTEX>
+struct ContentionProbe<policy::ReadWrite<MUTEX>>
+{
+  template<bool writable, typename UNLOCKED>
+  static LockProbe probe(UNLOCKED const& unlocked)
+  {
+    if constexpr (requires (MUTEX& mutex) { mutex.try_rdlock(); mutex.try_wrlock(); })
+    {
+      auto& mutex = UnlockedAccessor<UNLOCKED>::get_mutex(unlocked);
+      if (!(writable ? mutex.try_wrlock() : mutex.try_rdlock()))
+        return LockProbe::locked;
+      if (writable)
+        mutex.wrunlock();
+      else
+        mutex.rdunlock();
+      return LockProbe::free;
+    }
+    else
+      return LockProbe::unknown;
+  }
+};
+
+} // namespace detail
+
+template<typename T, typename POLICY, unsigned int sample_interval>
+class Unlocked<T, policy::Instrumented<POLICY, sample_interval>> : public Unlocked<T, POLICY>
+{
+  public:
+    using base_type = Unlocked<T, POLICY>;
+    using data_type = T;
+    using policy_type = policy::Instrumented<POLICY, sample_interval>;
+
+  private:
+    mutable LockStatistics m_statistics;
+
+    // Base class of the access types, constructed before the access type of
+    // base_type that it precedes: decides whether this access is sampled and
+    // if so, probes the lock and reads the clock.
+    struct AccessStart
+    {
+      bool m_sampled = detail::sample_access<sample_interval>();
+      detail::LockProbe m_probe = detail::LockProbe::unknown;
+      uint64_t m_start = 0;
+
+      template<bool writable>
+      AccessStart(Unlocked const& unlocked, std::bool_constant<writable>)
+      {
+        if (m_sampled) [[unlikely]]
+        {
+          m_probe = detail::ContentionProbe<POLICY>::template probe<writable>(static_cast<base_type const&>(unlocked));
+          m_start = TscClock::now();
+        }
+      }
+
+      // Converting a read lock into a write lock can not be probed.
+      AccessStart()
+      {
+        if (m_sampled) [[unlikely]]
+          m_start = TscClock::now();
+      }
+    };
+
+    // Mixed into an access type: the wait time is the time between the end of
+    // the construction of AccessStart and the end of the construction of the
+    // access object; the hold time lasts until its destruction.
+    template<AccessKind kind>
+    class Timing
+    {
+      private:
+        LockStatistics* m_statistics;           // Null if this access is not sampled.
+        uint64_t m_start;
+        uint64_t m_acquired;
+        detail::LockProbe m_probe;
+
+      public:
+        Timing(Unlocked const& unlocked, AccessStart const& start) :
+          m_statistics(start.m_sampled ? &unlocked.m_statistics : nullptr), m_start(start.m_start),
+          m_acquired(start.m_sampled ? TscClock::now() : 0), m_probe(start.m_probe) { }
+
+        ~Timing()
+        {
+          if (!m_statistics) [[likely]]
+            return;
+          uint64_t const wait_ticks = m_acquired - m_start;
+          bool const contended = m_probe == detail::LockProbe::unknown ?
+            wait_ticks > LockStatistics::contended_ticks : m_probe == detail::LockProbe::locked;
+          m_statistics->record(kind, wait_ticks, TscClock::now() - m_acquired, contended, sample_interval);
+        }
+    };
+
+  public:
+    class wat;
+
+    class crat : private AccessStart, public base_type::crat
+    {
+      private:
+        Timing<AccessKind::crat> m_timing;
+
+      public:
+        explicit crat(Unlocked const& unlocked) :
+          AccessStart(unlocked, std::false_type{}), base_type::crat(unlocked), m_timing(unlocked, *this) { }
+    };
+
+    class rat : private AccessStart, public base_type::rat
+    {
+      private:
+        friend class wat;
+        Unlocked const& m_unlocked;
+        Timing<AccessKind::rat> m_timing;
+
+      public:
+        explicit rat(Unlocked& unlocked) :
+          AccessStart(unlocked, std::false_type{}), base_type::rat(unlocked), m_unlocked(unlocked), m_timing(unlocked, *this) { }
+    };
+
+    class wat : private AccessStart, public base_type::wat
+    {
+      private:
+        Timing<AccessKind::wat> m_timing;
+
+      public:
+        explicit wat(Unlocked& unlocked) :
+          AccessStart(unlocked, std::true_type{}), base_type::wat(unlocked), m_timing(unlocked, *this) { }
+        // Converting a read lock into a write lock; the conversion is recorded as wat wait time.
+        explicit wat(rat& read_access) : base_type::wat(read_access), m_timing(read_access.m_unlocked, *this) { }
+    };
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) : base_type(std::forward<ARGS>(args)...) { }
+
+    LockStatistics& statistics() const { return m_statistics; }
+};
+
+} // namespace threadsafe
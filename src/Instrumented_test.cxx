@@ -0,0 +1,199 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "AIFutexReadWriteMutex.h"
+#include "Instrumented.h"
+#include "debug.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <cassert>
+#include <algorithm>
+#include <exception>
+#include <atomic>
+
+// Overhead of policy::Instrumented, with and without sampling; contention
+// detection; and a report of the most contended objects of a small workload.
+
+using namespace threadsafe;
+
+int const number_of_threads = std::max(4U, std::thread::hardware_concurrency());
+int constexpr n = 1000000;
+
+long volatile sink;
+
+struct Foo
+{
+  long x = 0;
+};
+
+template<typename UNLOCKED>
+double ns_per_crat()
+{
+  UNLOCKED foo;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; ++i)
+  {
+    typename UNLOCKED::crat foo_r(foo);
+    sink = foo_r->x;
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+// A sampled access reads the clock three times.
+double ns_per_three_clock_reads()
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; ++i)
+    sink = TscClock::now() + TscClock::now() + TscClock::now();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+template<typename POLICY>
+void overhead(char const* name)
+{
+  double plain = ns_per_crat<Unlocked<Foo, POLICY>>();
+  double sampled = ns_per_crat<Unlocked<Foo, policy::Instrumented<POLICY>>>();
+  double every = ns_per_crat<Unlocked<Foo, policy::Instrumented<POLICY, 1>>>();
+  std::cout << name << ": " << plain << " ns per crat, instrumented: " << sampled << " ns (+" << (sampled - plain) <<
+    " ns), measuring every access: " << every << " ns (+" << (every - plain) << " ns)." << std::endl;
+}
+
+// An access that finds the lock taken is contended, however short it waits; one that finds it free is not.
+void test_contention()
+{
+  using unlocked_type = Unlocked<Foo, policy::Instrumented<policy::ReadWrite<AIFutexReadWriteMutex>, 1>>;
+  unlocked_type foo;
+  std::atomic<bool> reading{false};
+  std::thread reader;
+  {
+    unlocked_type::wat foo_w(foo);
+    reader = std::thread([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      reading = true;
+      unlocked_type::crat foo_r(foo);
+      sink = foo_r->x;
+    });
+    while (!reading)
+      std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  reader.join();
+  for (int i = 0; i < 1000; ++i)
+  {
+    unlocked_type::crat foo_r(foo);
+    sink = foo_r->x;
+  }
+  LockStatistics::Summary summary = foo.statistics().summary();
+  LockStatistics::Counters const& crat = summary.kinds[static_cast<int>(AccessKind::crat)];
+  LockStatistics::Counters const& wat = summary.kinds[static_cast<int>(AccessKind::wat)];
+  bool success = crat.acquisitions == 1001 && crat.contended == 1 && wat.acquisitions == 1 && wat.contended == 0;
+  std::cout << "Contention: " << (success ? "Success!" : "FAILED!") << std::endl;
+  assert(success);
+}
+
+// With sampling, counts are estimates: allow ten percent (over five standard deviations here).
+bool about(uint64_t estimate, uint64_t exact)
+{
+  return estimate > exact * 0.9 && estimate < exact * 1.1;
+}
+
+using instrumented_policy = policy::Instrumented<policy::ReadWrite<AIReadWriteMutex>>;
+using unlocked_Foo_t = Unlocked<Foo, instrumented_policy>;
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::cout << "Reading TscClock three times: " << ns_per_three_clock_reads() << " ns." << std::endl;
+  overhead<policy::OneThread>("OneThread");
+  overhead<policy::Primitive<std::mutex>>("Primitive<std::mutex>");
+  overhead<policy::ReadWrite<AIReadWriteMutex>>("ReadWrite<AIReadWriteMutex>");
+  test_contention();
+
+  // hot is written by every thread, warm is mostly read, cold is only used by the first thread.
+  unlocked_Foo_t hot, warm, cold;
+  hot.statistics().set_name("hot");
+  warm.statistics().set_name("warm");
+  cold.statistics().set_name("cold");
+
+  int constexpr ops = 100000;
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < number_of_threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops; ++i)
+      {
+        {
+          unlocked_Foo_t::wat hot_w(hot);
+          ++hot_w->x;
+        }
+        if (i % 10 == 0)
+        {
+          for (;;)
+          {
+            try
+            {
+              unlocked_Foo_t::rat warm_r(warm);
+              if (warm_r->x < i)
+              {
+                unlocked_Foo_t::wat warm_w(warm_r);
+                warm_w->x = i;
+              }
+            }
+            catch (std::exception const&)
+            {
+              // Another thread is converting its read lock; let it finish first.
+              warm.rd2wryield();
+              continue;
+            }
+            break;
+          }
+        }
+        else
+        {
+          unlocked_Foo_t::crat warm_r(warm);
+          sink = warm_r->x;
+        }
+        if (t == 0)
+        {
+          unlocked_Foo_t::crat cold_r(cold);
+          sink = cold_r->x;
+        }
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+
+  // Short lived threads pass their stripe on to the next thread.
+  int constexpr generations = 50;
+  for (int g = 0; g < generations; ++g)
+  {
+    std::thread thread([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      for (int i = 0; i < ops / generations; ++i)
+      {
+        unlocked_Foo_t::crat cold_r(cold);
+        sink = cold_r->x;
+      }
+    });
+    thread.join();
+  }
+
+  auto summaries = LockStatisticsRegistry::instance().top_contended(10);
+  assert(summaries.size() == 3);          // test_contention's foo is gone.
+  for (auto const& summary : summaries)
+  {
+    uint64_t acquisitions = 0;
+    for (auto const& counters : summary.kinds)
+      acquisitions += counters.acquisitions;
+    if (summary.name == "hot")
+      assert(about(summary.kinds[static_cast<int>(AccessKind::wat)].acquisitions, static_cast<uint64_t>(number_of_threads) * ops));
+    else if (summary.name == "cold")
+      assert(about(acquisitions, 2 * ops));
+  }
+  LockStatisticsRegistry::instance().dump(std::cout);
+}
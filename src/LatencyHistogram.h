@@ -0,0 +1,113 @@
+#pragma once
+
+#include "LogLinearBuckets.h"
+
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+
+namespace threadsafe {
+
+// Distribution of the latencies of individual operations, in nanoseconds.
+//
+// Like WaitStatistics, but not thread-safe: every thread records into its own
+// histogram and the results are merged afterwards, so that recording costs no
+// more than an increment. Values are counted in HDR-style log-linear buckets,
+// 128 per power of two, so that percentiles are accurate to within 1%.
+// The minimum and maximum are exact.
+class LatencyHistogram
+{
+  private:
+    using buckets_type = LogLinearBuckets<7>;
+    static constexpr int number_of_buckets = buckets_type::number_of_buckets;
+
+    std::array<uint64_t, number_of_buckets> m_buckets{};
+    uint64_t m_count = 0;
+    uint64_t m_total_ns = 0;
+    uint64_t m_min_ns = UINT64_MAX;
+    uint64_t m_max_ns = 0;
+
+  public:
+    void record(uint64_t ns, uint64_t times = 1)
+    {
+      m_buckets[buckets_type::bucket(ns)] += times;
+      m_count += times;
+      m_total_ns += ns * times;
+      m_min_ns = std::min(m_min_ns, ns);
+      m_max_ns = std::max(m_max_ns, ns);
+    }
+
+    // Record ns, correcting for coordinated omission.
+    //
+    // A benchmark that starts the next operation only after the previous one
+    // finished stops sampling while an operation stalls: of the operations that
+    // should have started every expected_interval_ns in the meantime, none is
+    // recorded. Those are added here, with the latencies they would have seen:
+    // ns - expected_interval_ns, ns - 2 * expected_interval_ns, and so on, down
+    // to the last one that is still at least expected_interval_ns (as HdrHistogram's
+    // recordValueWithExpectedInterval does).
+    //
+    // This is only for such closed loop runs; an open loop run that measures
+    // every latency from the intended start time of the operation must use record().
+    void record_corrected(uint64_t ns, uint64_t expected_interval_ns)
+    {
+      record(ns);
+      if (expected_interval_ns == 0 || ns <= expected_interval_ns)
+        return;
+      for (uint64_t missed = ns - expected_interval_ns; missed >= expected_interval_ns; missed -= expected_interval_ns)
+        record(missed);
+    }
+
+    void merge(LatencyHistogram const& other)
+    {
+      for (int index = 0; index < number_of_buckets; ++index)
+        m_buckets[index] += other.m_buckets[index];
+      m_count += other.m_count;
+      m_total_ns += other.m_total_ns;
+      m_min_ns = std::min(m_min_ns, other.m_min_ns);
+      m_max_ns = std::max(m_max_ns, other.m_max_ns);
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t min_ns() const { return m_count == 0 ? 0 : m_min_ns; }
+    uint64_t max_ns() const { return m_max_ns; }
+    double mean_ns() const { return m_count == 0 ? 0.0 : static_cast<double>(m_total_ns) / m_count; }
+
+    // The latency that fraction (0...1) of all operations did not exceed.
+    uint64_t percentile_ns(double fraction) const
+    {
+      if (m_count == 0)
+        return 0;
+      uint64_t const rank = std::max(uint64_t{1}, static_cast<uint64_t>(fraction * m_count + 0.5));
+      uint64_t seen = 0;
+      for (int index = 0; index < number_of_buckets; ++index)
+        if ((seen += m_buckets[index]) >= rank)
+          return std::clamp(buckets_type::upper_bound(index), min_ns(), max_ns());
+      return m_max_ns;
+    }
+
+    void reset()
+    {
+      *this = LatencyHistogram{};
+    }
+
+    // Print the column headers that match operator<<.
+    static void print_header(std::ostream& os)
+    {
+      os << std::setw(12) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" <<
+        std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "p99.99" << std::setw(10) << "max";
+    }
+
+    // Prints the count, and the mean, percentiles and maximum in nanoseconds.
+    friend std::ostream& operator<<(std::ostream& os, LatencyHistogram const& histogram)
+    {
+      os << std::setw(12) << histogram.count() << std::fixed << std::setprecision(1) << std::setw(10) << histogram.mean_ns();
+      for (double fraction : { 0.5, 0.9, 0.99, 0.999, 0.9999 })
+        os << std::setw(10) << histogram.percentile_ns(fraction);
+      return os << std::setw(10) << histogram.max_ns();
+    }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,169 @@
+#include "sys.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "LatencyHistogram.h"
+#include "LogLinearBuckets.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cassert>
+#include <cmath>
+
+// LatencyHistogram: first check the accuracy of the percentiles against known
+// distributions; then time 1,000,000 uncontended rdlock/rdunlock calls of which
+// one stalls for 200 us, to show what batch averages, per-operation latencies
+// and the correction for coordinated omission make of that stall.
+
+using namespace threadsafe;
+using clock_type = std::chrono::steady_clock;
+
+int constexpr ops = 1000000;
+int constexpr batch = 50000;                    // Batch size of the averages, as microbench_stats in AIReadWriteSpinLock_test.cxx.
+int constexpr stall_ns = 200000;
+uint64_t constexpr interval_ns = 1000;          // The intended time between the starts of two operations.
+
+// Every bucket starts right after the previous one ends, for the numbering of all three histograms.
+template<int sub_bucket_bits>
+bool test_buckets()
+{
+  using buckets_type = LogLinearBuckets<sub_bucket_bits>;
+  bool success = buckets_type::bucket(0) == 0 && buckets_type::bucket(UINT64_MAX) == buckets_type::number_of_buckets - 1 &&
+    buckets_type::upper_bound(buckets_type::number_of_buckets - 1) == UINT64_MAX;
+  for (int index = 0; index < buckets_type::number_of_buckets - 1; ++index)
+  {
+    uint64_t const last = buckets_type::upper_bound(index);
+    success = success && buckets_type::bucket(last) == index && buckets_type::bucket(last + 1) == index + 1;
+  }
+  return success;
+}
+
+void test_accuracy()
+{
+  LatencyHistogram histogram;
+  for (uint64_t ns = 1; ns <= 1000000; ++ns)
+    histogram.record(ns);
+  bool success = histogram.count() == 1000000 && histogram.min_ns() == 1 && histogram.max_ns() == 1000000;
+  success = success && test_buckets<0>() && test_buckets<3>() && test_buckets<7>();
+  for (double fraction : { 0.5, 0.9, 0.99, 0.999, 0.9999 })
+  {
+    double const exact = fraction * 1000000;
+    success = success && std::abs(histogram.percentile_ns(fraction) - exact) <= 0.01 * exact;
+  }
+
+  // Values in the last sub-bucket of a power of two.
+  for (uint64_t ns : { 511, 1023, 4095, 1048575 })
+  {
+    LatencyHistogram top;
+    top.record(1, 99);
+    top.record(ns);
+    success = success && top.percentile_ns(0.995) == ns && top.percentile_ns(1.0) == ns;
+  }
+  LatencyHistogram tops;
+  tops.record(2047);
+  tops.record(2047 * 128);              // Not the largest value, so the percentile is not clamped by the maximum.
+  tops.record(UINT64_MAX / 2);
+  uint64_t const p50 = tops.percentile_ns(0.5);
+  success = success && p50 >= 2047 * 128 && p50 <= 2047 * 128 + 2047 * 128 / 100;
+
+  // Small values are exact.
+  LatencyHistogram small;
+  small.record(3, 99);
+  small.record(200);
+  success = success && small.percentile_ns(0.99) == 3 && small.percentile_ns(0.999) == 200;
+
+  // A stall of 100 intervals in a closed loop accounts for 99 operations that were never started.
+  LatencyHistogram corrected;
+  corrected.record_corrected(100000, 1000);
+  success = success && corrected.count() == 100 && corrected.min_ns() == 1000 && corrected.max_ns() == 100000;
+
+  // When the stall is not a multiple of the interval, no back-filled operation is shorter than the interval: 10, 7 and 4.
+  LatencyHistogram uneven;
+  uneven.record_corrected(10, 3);
+  success = success && uneven.count() == 3 && uneven.min_ns() == 4 && uneven.max_ns() == 10;
+  LatencyHistogram short_stall;
+  short_stall.record_corrected(5, 3);
+  success = success && short_stall.count() == 1 && short_stall.min_ns() == 5;
+
+  LatencyHistogram merged;
+  merged.merge(small);
+  merged.merge(corrected);
+  success = success && merged.count() == 200 && merged.min_ns() == 3 && merged.max_ns() == 100000;
+
+  std::cout << "Accuracy: " << (success ? "Success!" : "FAILED!") << std::endl;
+  assert(success);
+}
+
+AIReadWriteSpinLock lock;
+
+void operation(int i)
+{
+  lock.rdlock();
+  if (i == ops / 2)
+  {
+    auto const end = clock_type::now() + std::chrono::nanoseconds(stall_ns);
+    while (clock_type::now() < end)
+      ;
+  }
+  lock.rdunlock();
+}
+
+uint64_t elapsed_ns(clock_type::time_point start, clock_type::time_point end)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_accuracy();
+
+  // Batch averages.
+  double max_batch_ns = 0.0;
+  double total_ns = 0.0;
+  for (int b = 0; b < ops / batch; ++b)
+  {
+    auto start = clock_type::now();
+    for (int i = b * batch; i < (b + 1) * batch; ++i)
+      operation(i);
+    double const ns = elapsed_ns(start, clock_type::now());
+    total_ns += ns;
+    max_batch_ns = std::max(max_batch_ns, ns / batch);
+  }
+  std::cout << "Batch averages: avg: " << std::fixed << std::setprecision(2) << total_ns / ops << "ns, max: " << max_batch_ns << "ns" << std::endl;
+
+  // The same, timing every operation; this includes the overhead of reading the clock.
+  LatencyHistogram closed_loop;
+  LatencyHistogram corrected;
+  for (int i = 0; i < ops; ++i)
+  {
+    auto start = clock_type::now();
+    operation(i);
+    uint64_t const ns = elapsed_ns(start, clock_type::now());
+    closed_loop.record(ns);
+    corrected.record_corrected(ns, interval_ns);
+  }
+
+  // An open loop run that starts an operation every interval_ns, and measures
+  // every latency from that intended start time: the operations that are
+  // late because of the stall are counted as such.
+  LatencyHistogram open_loop;
+  auto const interval = std::chrono::nanoseconds(interval_ns);
+  auto intended = clock_type::now();
+  for (int i = 0; i < ops; ++i)
+  {
+    intended += interval;
+    while (clock_type::now() < intended)
+      ;
+    operation(i);
+    open_loop.record(elapsed_ns(intended, clock_type::now()));
+  }
+
+  std::cout << std::setw(24) << std::left << "Latency in ns" << std::right;
+  LatencyHistogram::print_header(std::cout);
+  std::cout << '\n' << std::setw(24) << std::left << "closed loop" << std::right << closed_loop <<
+               '\n' << std::setw(24) << std::left << "closed loop, corrected" << std::right << corrected <<
+               '\n' << std::setw(24) << std::left << "open loop" << std::right << open_loop << std::endl;
+  assert(closed_loop.max_ns() >= stall_ns);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "UnlockedAccessor.h"
+
+#include <tuple>
+#include <optional>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include <cassert>
+
+namespace threadsafe {
+
+// Obtain access to several Unlocked / UnlockedBase objects at once.
+//
+//   auto [from_w, to_w, rate_r] = lock_all(write(from), write(to), read(rate));
+//   from_w->balance -= amount * rate_r->value;
+//   to_w->balance += amount * rate_r->value;
+//
+// write(x) results in a wat, read(x) in a rat (or a crat when x is const).
+// The objects may use different policies (Primitive, ReadWrite, ...).
+//
+// The locks are always taken in the same global order (by address of the
+// mutex, or of the object when its policy has no mutex), no matter in which
+// order the objects are passed. Hence two lock_all calls can never deadlock
+// with each other. Nesting a wat inside the scope of a lock_all (or vice versa)
+// is as dangerous as before. Each mutex may be passed at most once; this
+// includes UnlockedBase objects that refer to the same Unlocked.
+
+template<typename UNLOCKED, typename ACCESS>
+struct AccessRequest
+{
+  using unlocked_type = UNLOCKED;
+  using access_type = ACCESS;
+  UNLOCKED& m_unlocked;
+};
+
+template<typename UNLOCKED>
+AccessRequest<UNLOCKED, typename UNLOCKED::wat> write(UNLOCKED& unlocked)
+{
+  return { unlocked };
+}
+
+template<typename UNLOCKED>
+AccessRequest<UNLOCKED, typename UNLOCKED::rat> read(UNLOCKED& unlocked)
+{
+  return { unlocked };
+}
+
+template<typename UNLOCKED>
+AccessRequest<UNLOCKED const, typename UNLOCKED::crat> read(UNLOCKED const& unlocked)
+{
+  return { unlocked };
+}
+
+namespace detail {
+
+// The address that determines the locking order of unlocked.
+template<typename UNLOCKED>
+void const* lock_order_key(UNLOCKED const& unlocked)
+{
+  if constexpr (requires { UnlockedAccessor<UNLOCKED>::get_mutex(unlocked); })
+    return &UnlockedAccessor<UNLOCKED>::get_mutex(unlocked);
+  else
+    return &unlocked;
+}
+
+} // namespace detail
+
+template<typename... REQUESTS>
+class MultiAccess
+{
+  private:
+    static constexpr std::size_t size = sizeof...(REQUESTS);
+
+    std::tuple<std::optional<typename REQUESTS::access_type>...> m_accesses;
+
+    template<std::size_t... I>
+    void acquire(std::tuple<REQUESTS...> const& requests, std::index_sequence<I...>)
+    {
+      using key_type = std::pair<void const*, std::size_t>;
+      std::array<key_type, size> order{{ key_type{detail::lock_order_key(std::get<I>(requests).m_unlocked), I}... }};
+      std::sort(order.begin(), order.end(), [](key_type const& a, key_type const& b){ return std::less<void const*>{}(a.first, b.first); });
+      for (std::size_t k = 0; k < size; ++k)
+      {
+        // Locking the same mutex twice would deadlock.
+        assert(k == 0 || order[k - 1].first != order[k].first);
+        // Construct the access object with index order[k].second.
+        ((I == order[k].second ? (void)std::get<I>(m_accesses).emplace(std::get<I>(requests).m_unlocked) : (void)0), ...);
+      }
+    }
+
+  public:
+    explicit MultiAccess(REQUESTS... requests)
+    {
+      acquire(std::tuple<REQUESTS...>(requests...), std::index_sequence_for<REQUESTS...>{});
+    }
+
+    MultiAccess(MultiAccess const&) = delete;
+    MultiAccess& operator=(MultiAccess const&) = delete;
+
+    // The access object of the I-th request.
+    template<std::size_t I>
+    auto& get() { return *std::get<I>(m_accesses); }
+
+    template<std::size_t I>
+    auto const& get() const { return *std::get<I>(m_accesses); }
+};
+
+template<typename... REQUESTS>
+MultiAccess<REQUESTS...> lock_all(REQUESTS... requests)
+{
+  return MultiAccess<REQUESTS...>(requests...);
+}
+
+} // namespace threadsafe
+
+// Support for structured bindings.
+template<typename... REQUESTS>
+struct std::tuple_size<threadsafe::MultiAccess<REQUESTS...>> : std::integral_constant<std::size_t, sizeof...(REQUESTS)> { };
+
+template<std::size_t I, typename... REQUESTS>
+struct std::tuple_element<I, threadsafe::MultiAccess<REQUESTS...>>
+{
+  using type = typename std::tuple_element_t<I, std::tuple<REQUESTS...>>::access_type;
+};
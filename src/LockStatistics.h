@@ -0,0 +1,301 @@
+#pragma once
+
+#include "ThreadSlot.h"
+#include "LogLinearBuckets.h"
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace threadsafe {
+
+// A cheap clock for measuring short intervals: the time stamp counter where
+// available, otherwise std::chrono::steady_clock in nanoseconds.
+struct TscClock
+{
+  static uint64_t now()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  // Calibrated on first use (takes 10 ms), so only call this when reporting.
+  static double ns_per_tick()
+  {
+    static double const s_ns_per_tick = []{
+      auto start = std::chrono::steady_clock::now();
+      uint64_t start_ticks = now();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      uint64_t ticks = now() - start_ticks;
+      double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      return ticks == 0 ? 1.0 : ns / ticks;
+    }();
+    return s_ns_per_tick;
+  }
+};
+
+// Which kind of access was recorded.
+enum class AccessKind { crat, rat, wat };
+constexpr int number_of_access_kinds = 3;
+inline char const* to_string(AccessKind kind) { return kind == AccessKind::crat ? "crat" : kind == AccessKind::rat ? "rat" : "wat"; }
+
+// Acquisition count, contended count, and wait and hold time histograms per access kind
+// for one lock.
+//
+// The counters are kept per thread: every running thread with a live_thread_slot()
+// below max_private_stripes gets a stripe of its own the first time it uses the lock,
+// and updates it with plain loads and stores. A stripe is passed on, counts and
+// all, to the next thread that gets the same slot. Threads beyond that share one
+// stripe and use atomic additions. summary() adds up all stripes. Time is measured
+// in TscClock ticks and histograms have one bucket per power of two. A caller
+// that only measures one in N acquisitions records each with a weight of N.
+// All instances register themselves with LockStatisticsRegistry.
+class LockStatistics
+{
+  public:
+    using buckets_type = LogLinearBuckets<0>;
+    static constexpr int number_of_buckets = 40;
+    static constexpr unsigned int max_private_stripes = 256;
+    // An acquisition that waited longer than this is counted as contended, when
+    // the caller has no better way to tell.
+    static constexpr uint64_t contended_ticks = 512;
+
+    struct Counters
+    {
+      uint64_t acquisitions = 0;
+      uint64_t contended = 0;
+      uint64_t wait_ticks = 0;
+      uint64_t hold_ticks = 0;
+      std::array<uint64_t, number_of_buckets> wait_histogram{};
+      std::array<uint64_t, number_of_buckets> hold_histogram{};
+
+      // The (upper bound of the) bucket that contains fraction of all values, in ns.
+      static double percentile_ns(std::array<uint64_t, number_of_buckets> const& histogram, double fraction);
+    };
+
+    struct Summary
+    {
+      std::string name;
+      std::array<Counters, number_of_access_kinds> kinds;
+
+      uint64_t contended() const { uint64_t sum = 0; for (auto& k : kinds) sum += k.contended; return sum; }
+      uint64_t wait_ticks() const { uint64_t sum = 0; for (auto& k : kinds) sum += k.wait_ticks; return sum; }
+    };
+
+  private:
+    struct AtomicCounters
+    {
+      std::atomic<uint64_t> acquisitions{0};
+      std::atomic<uint64_t> contended{0};
+      std::atomic<uint64_t> wait_ticks{0};
+      std::atomic<uint64_t> hold_ticks{0};
+      std::array<std::atomic<uint64_t>, number_of_buckets> wait_histogram{};
+      std::array<std::atomic<uint64_t>, number_of_buckets> hold_histogram{};
+    };
+
+    struct alignas(cache_line_size) Stripe
+    {
+      std::array<AtomicCounters, number_of_access_kinds> kinds;
+    };
+
+    std::array<std::atomic<Stripe*>, max_private_stripes> m_private_stripes{};
+    Stripe m_shared_stripe;
+    std::string m_name;
+
+    // Longer times are counted in the last bucket.
+    static int bucket(uint64_t ticks)
+    {
+      return std::min(buckets_type::bucket(ticks), number_of_buckets - 1);
+    }
+
+    template<bool exclusive>
+    static void add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+      if constexpr (exclusive)
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+      else
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    template<bool exclusive>
+    static void record(AtomicCounters& counters, uint64_t wait_ticks, uint64_t hold_ticks, bool contended, uint64_t weight)
+    {
+      add<exclusive>(counters.acquisitions, weight);
+      if (contended)
+        add<exclusive>(counters.contended, weight);
+      add<exclusive>(counters.wait_ticks, wait_ticks * weight);
+      add<exclusive>(counters.hold_ticks, hold_ticks * weight);
+      add<exclusive>(counters.wait_histogram[bucket(wait_ticks)], weight);
+      add<exclusive>(counters.hold_histogram[bucket(hold_ticks)], weight);
+    }
+
+  public:
+    inline LockStatistics();
+    inline ~LockStatistics();
+
+    LockStatistics(LockStatistics const&) = delete;
+    LockStatistics& operator=(LockStatistics const&) = delete;
+
+    // The name used in reports; set it before other threads use the lock.
+    void set_name(std::string name) { m_name = std::move(name); }
+    std::string const& name() const { return m_name; }
+
+    // Record one acquisition, or weight acquisitions when only one in weight is measured.
+    void record(AccessKind kind, uint64_t wait_ticks, uint64_t hold_ticks, bool contended, uint64_t weight = 1)
+    {
+      unsigned int slot = live_thread_slot();
+      if (slot >= max_private_stripes) [[unlikely]]
+      {
+        record<false>(m_shared_stripe.kinds[static_cast<int>(kind)], wait_ticks, hold_ticks, contended, weight);
+        return;
+      }
+      // Only the owner of slot writes m_private_stripes[slot].
+      Stripe* stripe = m_private_stripes[slot].load(std::memory_order_relaxed);
+      if (!stripe) [[unlikely]]
+      {
+        stripe = new Stripe;
+        m_private_stripes[slot].store(stripe, std::memory_order_release);
+      }
+      record<true>(stripe->kinds[static_cast<int>(kind)], wait_ticks, hold_ticks, contended, weight);
+    }
+
+    // Add up all stripes.
+    Summary summary() const
+    {
+      Summary summary;
+      summary.name = m_name;
+      auto add_stripe = [&summary](Stripe const& stripe){
+        for (int k = 0; k < number_of_access_kinds; ++k)
+        {
+          AtomicCounters const& from = stripe.kinds[k];
+          Counters& to = summary.kinds[k];
+          to.acquisitions += from.acquisitions.load(std::memory_order_relaxed);
+          to.contended += from.contended.load(std::memory_order_relaxed);
+          to.wait_ticks += from.wait_ticks.load(std::memory_order_relaxed);
+          to.hold_ticks += from.hold_ticks.load(std::memory_order_relaxed);
+          for (int b = 0; b < number_of_buckets; ++b)
+          {
+            to.wait_histogram[b] += from.wait_histogram[b].load(std::memory_order_relaxed);
+            to.hold_histogram[b] += from.hold_histogram[b].load(std::memory_order_relaxed);
+          }
+        }
+      };
+      add_stripe(m_shared_stripe);
+      for (std::atomic<Stripe*> const& private_stripe : m_private_stripes)
+        if (Stripe const* stripe = private_stripe.load(std::memory_order_acquire))
+          add_stripe(*stripe);
+      return summary;
+    }
+};
+
+inline double LockStatistics::Counters::percentile_ns(std::array<uint64_t, number_of_buckets> const& histogram, double fraction)
+{
+  uint64_t total = 0;
+  for (uint64_t count : histogram)
+    total += count;
+  if (total == 0)
+    return 0.0;
+  uint64_t const rank = std::max(uint64_t{1}, static_cast<uint64_t>(fraction * total + 0.5));
+  uint64_t seen = 0;
+  int b = 0;
+  while ((seen += histogram[b]) < rank)
+    ++b;
+  return static_cast<double>(buckets_type::upper_bound(b)) * TscClock::ns_per_tick();
+}
+
+// All LockStatistics objects that exist, so that a running process can report
+// its most contended locks.
+class LockStatisticsRegistry
+{
+  private:
+    mutable std::mutex m_mutex;
+    std::vector<LockStatistics*> m_statistics;          // Protected by m_mutex.
+
+    LockStatisticsRegistry() = default;
+
+  public:
+    static LockStatisticsRegistry& instance()
+    {
+      static LockStatisticsRegistry s_registry;
+      return s_registry;
+    }
+
+    void add(LockStatistics* statistics)
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_statistics.push_back(statistics);
+    }
+
+    void remove(LockStatistics* statistics)
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_statistics.erase(std::remove(m_statistics.begin(), m_statistics.end(), statistics), m_statistics.end());
+    }
+
+    // The summaries of the max_count locks with the highest total wait time.
+    std::vector<LockStatistics::Summary> top_contended(size_t max_count) const
+    {
+      std::vector<LockStatistics::Summary> summaries;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (LockStatistics const* statistics : m_statistics)
+          summaries.push_back(statistics->summary());
+      }
+      std::sort(summaries.begin(), summaries.end(),
+          [](LockStatistics::Summary const& a, LockStatistics::Summary const& b){ return a.wait_ticks() > b.wait_ticks(); });
+      if (summaries.size() > max_count)
+        summaries.resize(max_count);
+      return summaries;
+    }
+
+    // Print the max_count most contended locks.
+    void dump(std::ostream& os, size_t max_count = 10) const
+    {
+      double const ns_per_tick = TscClock::ns_per_tick();
+      os << std::left << std::setw(24) << "lock" << std::setw(6) << "kind" << std::right << std::setw(12) << "acquired" <<
+        std::setw(12) << "contended" << std::setw(14) << "wait ms" << std::setw(12) << "wait p99" << std::setw(14) << "hold ms" <<
+        std::setw(12) << "hold p99" << '\n';
+      for (LockStatistics::Summary const& summary : top_contended(max_count))
+        for (int k = 0; k < number_of_access_kinds; ++k)
+        {
+          LockStatistics::Counters const& counters = summary.kinds[k];
+          if (counters.acquisitions == 0)
+            continue;
+          os << std::left << std::setw(24) << (summary.name.empty() ? "<unnamed>" : summary.name) <<
+            std::setw(6) << to_string(static_cast<AccessKind>(k)) << std::right << std::setw(12) << counters.acquisitions <<
+            std::setw(12) << counters.contended << std::fixed << std::setprecision(3) <<
+            std::setw(14) << counters.wait_ticks * ns_per_tick / 1e6 <<
+            std::setw(12) << std::setprecision(0) << LockStatistics::Counters::percentile_ns(counters.wait_histogram, 0.99) <<
+            std::setw(14) << std::setprecision(3) << counters.hold_ticks * ns_per_tick / 1e6 <<
+            std::setw(12) << std::setprecision(0) << LockStatistics::Counters::percentile_ns(counters.hold_histogram, 0.99) << '\n';
+        }
+    }
+};
+
+LockStatistics::LockStatistics()
+{
+  LockStatisticsRegistry::instance().add(this);
+}
+
+LockStatistics::~LockStatistics()
+{
+  LockStatisticsRegistry::instance().remove(this);
+  for (std::atomic<Stripe*>& private_stripe : m_private_stripes)
+    delete private_stripe.load(std::memory_order_relaxed);
+}
+
+} // namespace threadsafe
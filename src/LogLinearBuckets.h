@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+namespace threadsafe {
+
+// The bucket numbering of the histograms of WaitStatistics, LatencyHistogram and LockStatistics.
+//
+// Values below linear_limit have a bucket of their own. Above that, every power
+// of two is split into sub_buckets buckets of equal width (as in HdrHistogram),
+// so that all values in a bucket are within 1 / sub_buckets of its upper bound.
+// With sub_bucket_bits = 0 there is one bucket per power of two.
+template<int sub_bucket_bits>
+struct LogLinearBuckets
+{
+  static constexpr int sub_buckets = 1 << sub_bucket_bits;
+  static constexpr int linear_limit = 2 * sub_buckets;
+  static constexpr int number_of_buckets = linear_limit + (64 - sub_bucket_bits - 1) * sub_buckets;
+
+  // The index of the bucket that counts value.
+  static constexpr int bucket(uint64_t value)
+  {
+    if (value < linear_limit)
+      return value;
+    int msb = 63 - __builtin_clzll(value);
+    int sub = (value >> (msb - sub_bucket_bits)) & (sub_buckets - 1);
+    return linear_limit + (msb - sub_bucket_bits - 1) * sub_buckets + sub;
+  }
+
+  // The largest value that is counted in bucket index.
+  static constexpr uint64_t upper_bound(int index)
+  {
+    if (index < linear_limit)
+      return index;
+    int msb = (index - linear_limit) / sub_buckets + sub_bucket_bits + 1;
+    uint64_t sub = (index - linear_limit) % sub_buckets;
+    return (uint64_t{1} << msb) + ((sub + 1) << (msb - sub_bucket_bits)) - 1;
+  }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace threadsafe {
+
+// A group of hardware and software performance counters (see perf_event_open(2))
+// that count what the calling thread does between start() and stop().
+//
+// Counters that can't be opened, for example because the kernel doesn't allow it
+// (perf_event_paranoid, seccomp in a container) or because the (virtual) CPU has
+// no such event, are left out and printed as "-"; on such machines the benchmarks
+// just report less. Where counting in the kernel is not allowed, only user space
+// is counted.
+//
+// There is no generic event for loads that hit a modified line in another core's
+// cache (HITM). Set the environment variable THREADSAFE_PERF_HITM to the raw event
+// of this CPU to count those; for example 0x04d2 (MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM)
+// on Skylake. Without it, coherence misses show up as L1D misses.
+class PerfCounters
+{
+  public:
+    enum Event { instructions, cycles, l1d_misses, llc_misses, hitm, context_switches, number_of_events };
+
+    // The counts of one measurement.
+    struct Counts
+    {
+      std::array<double, number_of_events> m_values{};
+      std::array<bool, number_of_events> m_available{};
+
+      Counts& operator+=(Counts const& other)
+      {
+        for (int event = 0; event < number_of_events; ++event)
+        {
+          m_values[event] += other.m_values[event];
+          m_available[event] = m_available[event] || other.m_available[event];
+        }
+        return *this;
+      }
+    };
+
+  private:
+    std::array<int, number_of_events> m_fd;
+    int m_leader = -1;
+
+    static bool describe(Event event, perf_event_attr& attr)
+    {
+      switch (event)
+      {
+        case instructions:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+          return true;
+        case cycles:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_CPU_CYCLES;
+          return true;
+        case l1d_misses:
+          attr.type = PERF_TYPE_HW_CACHE;
+          attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+          return true;
+        case llc_misses:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_CACHE_MISSES;
+          return true;
+        case hitm:
+        {
+          char const* raw = std::getenv("THREADSAFE_PERF_HITM");
+          if (!raw || !*raw)
+            return false;
+          attr.type = PERF_TYPE_RAW;
+          attr.config = std::strtoull(raw, nullptr, 0);
+          return true;
+        }
+        case context_switches:
+          attr.type = PERF_TYPE_SOFTWARE;
+          attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+          return true;
+        case number_of_events:
+          break;
+      }
+      return false;
+    }
+
+    int open_counter(Event event, bool inherit)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      if (!describe(event, attr))
+        return -1;
+      attr.disabled = m_leader == -1;           // The group is enabled through its leader.
+      attr.inherit = inherit;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      int fd = syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0);
+      if (fd == -1)
+      {
+        attr.exclude_kernel = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0);
+      }
+      return fd;
+    }
+
+  public:
+    // Count the calling thread; if inherit is true then also the threads that it creates after this.
+    PerfCounters(bool inherit = false)
+    {
+      for (int event = 0; event < number_of_events; ++event)
+        if ((m_fd[event] = open_counter(static_cast<Event>(event), inherit)) != -1 && m_leader == -1)
+          m_leader = m_fd[event];
+    }
+
+    ~PerfCounters()
+    {
+      for (int fd : m_fd)
+        if (fd != -1)
+          close(fd);
+    }
+
+    PerfCounters(PerfCounters const&) = delete;
+    PerfCounters& operator=(PerfCounters const&) = delete;
+
+    // Returns false when no counter at all could be opened.
+    bool available() const { return m_leader != -1; }
+
+    void start()
+    {
+      if (m_leader == -1)
+        return;
+      ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    void stop()
+    {
+      if (m_leader != -1)
+        ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // The counts since the last start(), scaled up for the time that a counter
+    // was not running because the kernel multiplexed it with other events.
+    Counts read() const
+    {
+      Counts counts;
+      for (int event = 0; event < number_of_events; ++event)
+      {
+        uint64_t values[3];                     // value, time enabled, time running.
+        if (m_fd[event] == -1 || ::read(m_fd[event], values, sizeof(values)) != sizeof(values) || values[2] == 0)
+          continue;
+        counts.m_values[event] = static_cast<double>(values[0]) * values[1] / values[2];
+        counts.m_available[event] = true;
+      }
+      return counts;
+    }
+
+    // Print the column headers that match print().
+    static void print_header(std::ostream& os)
+    {
+      os << std::setw(10) << "instr/op" << std::setw(10) << "cycles/op" << std::setw(10) << "L1D/op" <<
+        std::setw(10) << "LLC/op" << std::setw(10) << "HITM/op" << std::setw(10) << "cs/op";
+    }
+
+    // Print counts divided by the number of operations.
+    static void print(std::ostream& os, Counts const& counts, double operations)
+    {
+      std::ios_base::fmtflags const flags = os.flags();
+      std::streamsize const precision = os.precision(3);
+      os.unsetf(std::ios_base::floatfield);
+      for (int event = 0; event < number_of_events; ++event)
+        if (counts.m_available[event])
+          os << std::setw(10) << counts.m_values[event] / operations;
+        else
+          os << std::setw(10) << "-";
+      os.precision(precision);
+      os.flags(flags);
+    }
+};
+
+} // namespace threadsafe
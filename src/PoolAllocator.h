@@ -0,0 +1,242 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "UnlockedLayout.h"
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <utility>
+
+namespace threadsafe {
+namespace pool {
+
+// Small object pool with size class freelists and per-thread caches.
+//
+// Requests of at most max_size bytes are rounded up to a multiple of granularity
+// and served from the freelist of that size class in the calling thread's cache,
+// which needs no locking at all. When a thread cache runs empty it takes a batch
+// of blocks from the global freelist of the size class (or carves up a new chunk);
+// when it holds more than 2 * batch_size blocks it returns batch_size of them.
+// Blocks may be freed by a different thread than the one that allocated them.
+//
+// Chunks are never given back to the system: the pool is meant for objects that
+// are created and destroyed at a high rate during the whole life of the program.
+
+constexpr std::size_t granularity = 16;
+constexpr std::size_t number_of_size_classes = 16;
+constexpr std::size_t max_size = granularity * number_of_size_classes;
+constexpr std::size_t batch_size = 32;
+constexpr std::size_t chunk_size = 64 * 1024;
+
+struct FreeBlock
+{
+  FreeBlock* m_next;
+};
+
+// A singly linked list of free blocks of the same size class.
+struct FreeList
+{
+  FreeBlock* m_head = nullptr;
+  std::size_t m_size = 0;
+
+  void push(void* ptr)
+  {
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->m_next = m_head;
+    m_head = block;
+    ++m_size;
+  }
+
+  void* pop()
+  {
+    FreeBlock* block = m_head;
+    m_head = block->m_next;
+    --m_size;
+    return block;
+  }
+
+  // Move (at most) n blocks from this list to the front of to.
+  void move_to(FreeList& to, std::size_t n)
+  {
+    while (n-- > 0 && m_head)
+      to.push(pop());
+  }
+};
+
+// Zero bytes are served from the smallest size class.
+constexpr std::size_t size_class(std::size_t bytes)
+{
+  return bytes == 0 ? 0 : (bytes + granularity - 1) / granularity - 1;
+}
+
+class Pool
+{
+  private:
+    using unlocked_FreeList_t = Unlocked<FreeList, policy::CacheAligned<policy::Primitive<std::mutex>>>;
+
+    unlocked_FreeList_t m_free_lists[number_of_size_classes];
+
+  public:
+    // Never destroyed; blocks might still be freed during static destruction.
+    static Pool& instance()
+    {
+      static Pool* s_pool = new Pool;
+      return *s_pool;
+    }
+
+    // Fill local with blocks of size class sc.
+    void refill(std::size_t sc, FreeList& local)
+    {
+      {
+        unlocked_FreeList_t::wat free_list_w(m_free_lists[sc]);
+        free_list_w->move_to(local, batch_size);
+      }
+      if (local.m_head)
+        return;
+      std::size_t const block_size = (sc + 1) * granularity;
+      char* chunk = static_cast<char*>(std::malloc(chunk_size));
+      if (!chunk)
+        throw std::bad_alloc();
+      for (std::size_t offset = 0; offset + block_size <= chunk_size; offset += block_size)
+        local.push(chunk + offset);
+    }
+
+    // Give n blocks of size class sc from local back to the global freelist.
+    void release(std::size_t sc, FreeList& local, std::size_t n)
+    {
+      unlocked_FreeList_t::wat free_list_w(m_free_lists[sc]);
+      local.move_to(*free_list_w, n);
+    }
+
+    // Allocate and free single blocks, for threads that have no cache (anymore).
+    void* allocate(std::size_t sc)
+    {
+      FreeList local;
+      refill(sc, local);
+      void* ptr = local.pop();
+      release(sc, local, local.m_size);
+      return ptr;
+    }
+
+    void deallocate(std::size_t sc, void* ptr)
+    {
+      unlocked_FreeList_t::wat free_list_w(m_free_lists[sc]);
+      free_list_w->push(ptr);
+    }
+};
+
+class ThreadCache
+{
+  private:
+    FreeList m_free_lists[number_of_size_classes];
+
+  public:
+    ~ThreadCache()
+    {
+      destroyed() = true;
+      for (std::size_t sc = 0; sc < number_of_size_classes; ++sc)
+        Pool::instance().release(sc, m_free_lists[sc], m_free_lists[sc].m_size);
+    }
+
+    void* allocate(std::size_t sc)
+    {
+      FreeList& free_list = m_free_lists[sc];
+      if (!free_list.m_head)
+        Pool::instance().refill(sc, free_list);
+      return free_list.pop();
+    }
+
+    void deallocate(std::size_t sc, void* ptr)
+    {
+      FreeList& free_list = m_free_lists[sc];
+      free_list.push(ptr);
+      if (free_list.m_size > 2 * batch_size)
+        Pool::instance().release(sc, free_list, batch_size);
+    }
+
+    // Only call this when destroyed() is false.
+    static ThreadCache& instance()
+    {
+      thread_local ThreadCache t_cache;
+      return t_cache;
+    }
+
+    // Set when the cache of the calling thread was destroyed, after which it might
+    // still free blocks (for example, of objects that are destroyed by other thread_local
+    // destructors, or from a static std::shared_ptr when the main thread exits).
+    static bool& destroyed()
+    {
+      thread_local bool t_destroyed = false;
+      return t_destroyed;
+    }
+};
+
+inline void* allocate(std::size_t sc)
+{
+  return ThreadCache::destroyed() ? Pool::instance().allocate(sc) : ThreadCache::instance().allocate(sc);
+}
+
+inline void deallocate(std::size_t sc, void* ptr)
+{
+  if (ThreadCache::destroyed())
+    Pool::instance().deallocate(sc, ptr);
+  else
+    ThreadCache::instance().deallocate(sc, ptr);
+}
+
+} // namespace pool
+
+// A standard allocator that uses the pool for objects of at most pool::max_size bytes.
+//
+// Use it with std::allocate_shared to put an object and its control block in a
+// single pooled block:
+//
+//   std::shared_ptr<Tracker> tracker = make_pooled_shared<Tracker>(args...);
+//
+// As with std::make_shared, the block is returned to the pool when the last
+// std::weak_ptr to the object is gone, not when the object is destroyed.
+template<typename T>
+class PoolAllocator
+{
+  private:
+    static constexpr bool pooled(std::size_t n)
+    {
+      return alignof(T) <= pool::granularity && n * sizeof(T) <= pool::max_size;
+    }
+
+  public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template<typename U>
+    PoolAllocator(PoolAllocator<U> const&) { }
+
+    T* allocate(std::size_t n)
+    {
+      if (!pooled(n))
+        return std::allocator<T>().allocate(n);
+      return static_cast<T*>(pool::allocate(pool::size_class(n * sizeof(T))));
+    }
+
+    void deallocate(T* ptr, std::size_t n)
+    {
+      if (!pooled(n))
+        std::allocator<T>().deallocate(ptr, n);
+      else
+        pool::deallocate(pool::size_class(n * sizeof(T)), ptr);
+    }
+
+    template<typename U>
+    bool operator==(PoolAllocator<U> const&) const { return true; }
+};
+
+template<typename T, typename... ARGS>
+std::shared_ptr<T> make_pooled_shared(ARGS&&... args)
+{
+  return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<ARGS>(args)...);
+}
+
+} // namespace threadsafe
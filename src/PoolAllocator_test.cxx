@@ -0,0 +1,145 @@
+#include "sys.h"
+#include "threadsafe/ObjectTracker.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "threadsafe/ObjectTracker.inl.h"
+#include "PoolAllocator.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Create/destroy throughput of TFooTracker objects (the ObjectTracker of the
+// TFoo in threadsafe_test.cxx), allocated with std::make_shared versus make_pooled_shared.
+//
+// Every thread keeps a window of live trackers of its own TFoo and, for half of
+// them, a std::weak_ptr<TFooTracker> that outlives the std::shared_ptr for a while
+// (as when a TFooTracker is looked up through a std::weak_ptr). Every iteration
+// the oldest tracker is replaced by a new one.
+
+using namespace threadsafe;
+
+int const number_of_threads = std::max(2U, std::thread::hardware_concurrency());
+int constexpr window = 1024;
+int constexpr ops = 2000000;
+
+struct locked_TFoo;
+
+using TFoo = threadsafe::UnlockedTrackedObject<locked_TFoo, threadsafe::policy::ReadWrite<AIReadWriteMutex>>;
+using TFooTracker = threadsafe::ObjectTracker<TFoo, locked_TFoo, threadsafe::policy::ReadWrite<AIReadWriteMutex>>;
+
+struct locked_TFoo : threadsafe::TrackedObject<TFoo, TFooTracker> {
+  int x;
+};
+
+struct MakeShared
+{
+  static std::shared_ptr<TFooTracker> create(TFoo& tfoo) { return std::make_shared<TFooTracker>(tfoo); }
+};
+
+struct MakePooledShared
+{
+  static std::shared_ptr<TFooTracker> create(TFoo& tfoo) { return make_pooled_shared<TFooTracker>(tfoo); }
+};
+
+template<typename FACTORY>
+void churn()
+{
+  TFoo tfoo;
+  std::vector<std::shared_ptr<TFooTracker>> trackers(window);
+  std::vector<std::weak_ptr<TFooTracker>> weak_trackers(window);
+  for (int i = 0; i < ops; ++i)
+  {
+    int slot = i % window;
+    trackers[slot] = FACTORY::create(tfoo);
+    // Keep a std::weak_ptr to every other tracker; it expires half a window later.
+    int weak_slot = (i + window / 2) % window;
+    if (i % 2 == 0)
+      weak_trackers[slot] = trackers[slot];
+    else
+      weak_trackers[weak_slot].reset();
+  }
+}
+
+template<typename FACTORY>
+double run(int threads)
+{
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < threads; ++t)
+    thread_pool.emplace_back([]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      churn<FACTORY>();
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return threads * ops / seconds / 1e6;
+}
+
+// Trackers handed to another thread are freed there.
+void cross_thread_free(TFoo& tfoo)
+{
+  std::vector<std::shared_ptr<TFooTracker>> trackers;
+  for (int i = 0; i < 10 * window; ++i)
+    trackers.push_back(make_pooled_shared<TFooTracker>(tfoo));
+  std::thread consumer([&]{
+    Debug(NAMESPACE_DEBUG::init_thread());
+    trackers.clear();
+  });
+  consumer.join();
+}
+
+// Trackers that are freed after the thread cache of their thread is gone.
+struct FreedAtExit
+{
+  std::shared_ptr<TFooTracker> m_tracker;
+};
+thread_local FreedAtExit t_freed_at_thread_exit;        // Destroyed after the thread cache, which is created later.
+FreedAtExit s_freed_at_exit;                            // Destroyed after all thread_local objects of the main thread.
+
+void free_at_exit(TFoo& tfoo)
+{
+  std::thread thread([&]{
+    Debug(NAMESPACE_DEBUG::init_thread());
+    t_freed_at_thread_exit.m_tracker.reset();           // Construct t_freed_at_thread_exit before the thread cache.
+    t_freed_at_thread_exit.m_tracker = make_pooled_shared<TFooTracker>(tfoo);
+  });
+  thread.join();
+  s_freed_at_exit.m_tracker = make_pooled_shared<TFooTracker>(tfoo);
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // A std::weak_ptr keeps working as usual: it expires with the last std::shared_ptr.
+  static TFoo tfoo;                     // Outlives s_freed_at_exit.
+  {
+    std::shared_ptr<TFooTracker> tracker = make_pooled_shared<TFooTracker>(tfoo);
+    std::weak_ptr<TFooTracker> weak_tracker = tracker;
+    assert(weak_tracker.lock() == tracker);
+    tracker.reset();
+    assert(weak_tracker.expired() && !weak_tracker.lock());
+  }
+  cross_thread_free(tfoo);
+  free_at_exit(tfoo);
+
+  // Zero sized allocations use the smallest size class.
+  PoolAllocator<TFooTracker> allocator;
+  allocator.deallocate(allocator.allocate(0), 0);
+
+  std::cout << "sizeof(TFooTracker) = " << sizeof(TFooTracker) << "; million trackers created and destroyed per second:" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(14) << "make_shared" << std::setw(20) << "make_pooled_shared" << std::endl;
+  for (int threads = 1; threads <= number_of_threads; threads *= 2)
+  {
+    double plain = run<MakeShared>(threads);
+    double pooled = run<MakePooledShared>(threads);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2) << std::setw(14) << plain << std::setw(20) << pooled << std::endl;
+  }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "EpochDomain.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <utility>
+
+namespace threadsafe {
+namespace policy {
+
+// Read-copy-update policy for large, read-mostly objects.
+//
+// Unlocked<T, policy::RCU> holds a pointer to the current version of T.
+// Read access (crat) pins the current epoch and dereferences that version;
+// readers never wait, not even while a writer is active. Write access (wat)
+// is serialized by a mutex and works on a private copy of the current version,
+// which is published atomically when the wat is destroyed. The old version is
+// retired to the EpochDomain and deleted once all readers that might still see
+// it have moved on; after the last write that happens in a later unpin() of a
+// reader, or when the Unlocked is destroyed.
+//
+// A crat keeps looking at the version that was current when it was created.
+// There is no rat to wat conversion; rat is the same as crat.
+struct RCU
+{
+};
+
+} // namespace policy
+
+template<typename T>
+class Unlocked<T, policy::RCU>
+{
+  public:
+    using data_type = T;
+    using policy_type = policy::RCU;
+
+  private:
+    std::atomic<T*> m_current;
+    std::mutex m_writer_mutex;                  // Serializes writers.
+
+  public:
+    class crat
+    {
+      private:
+        EpochDomain::Guard m_guard;
+        T const* m_version;
+
+      public:
+        explicit crat(Unlocked const& unlocked) : m_version(unlocked.m_current.load(std::memory_order_acquire)) { }
+
+        crat(crat const&) = delete;
+        crat& operator=(crat const&) = delete;
+
+        T const* operator->() const { return m_version; }
+        T const& operator*() const { return *m_version; }
+    };
+
+    using rat = crat;
+
+    class wat
+    {
+      private:
+        Unlocked* m_unlocked;
+        std::unique_lock<std::mutex> m_lock;
+        std::unique_ptr<T> m_copy;
+
+      public:
+        explicit wat(Unlocked& unlocked) :
+          m_unlocked(&unlocked), m_lock(unlocked.m_writer_mutex),
+          m_copy(std::make_unique<T>(*unlocked.m_current.load(std::memory_order_relaxed))) { }
+
+        ~wat()
+        {
+          T* old_version = m_unlocked->m_current.exchange(m_copy.release(), std::memory_order_acq_rel);
+          m_lock.unlock();
+          EpochDomain::instance().retire(old_version);
+        }
+
+        wat(wat const&) = delete;
+        wat& operator=(wat const&) = delete;
+
+        T* operator->() const { return m_copy.get(); }
+        T& operator*() const { return *m_copy; }
+    };
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) : m_current(new T(std::forward<ARGS>(args)...)) { }
+
+    // There may be no readers left when the object is destroyed. The versions
+    // that were retired before are deleted too, unless the calling thread is
+    // pinned (then they are left to a later collect()).
+    ~Unlocked()
+    {
+      delete m_current.load(std::memory_order_relaxed);
+      EpochDomain& domain = EpochDomain::instance();
+      if (domain.pending_objects() != 0 && !domain.is_pinned())
+      {
+        domain.synchronize();
+        domain.collect();
+      }
+    }
+
+    Unlocked(Unlocked const&) = delete;
+    Unlocked& operator=(Unlocked const&) = delete;
+};
+
+} // namespace threadsafe
@@ -0,0 +1,181 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "RCU.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+#include <type_traits>
+
+// Reader latency of Unlocked<RoutingTable, policy::RCU> with and without a writer
+// that continuously updates the table, compared with policy::ReadWrite<AIReadWriteMutex>;
+// plus the memory that is waiting to be reclaimed under sustained write load.
+
+using namespace threadsafe;
+
+int constexpr table_size = 1000;
+int constexpr n = 1000000;
+int constexpr sample = 16;
+int const number_of_readers = std::max(1U, std::thread::hardware_concurrency() - 1);
+
+struct RoutingTable
+{
+  std::map<int, int> routes;
+  int version = 0;
+
+  RoutingTable()
+  {
+    for (int i = 0; i < table_size; ++i)
+      routes[i] = i;
+  }
+};
+
+// Rough size of one version of the table: the red-black tree nodes hold a color and three pointers.
+constexpr size_t approximate_version_size = sizeof(RoutingTable) + table_size * (sizeof(std::map<int, int>::value_type) + 4 * sizeof(void*));
+
+struct Statistics
+{
+  double p50_ns;
+  double p99_ns;
+  double max_ns;
+  long writes;
+  size_t max_pending_objects;
+};
+
+long volatile sink;
+
+template<typename POLICY>
+Statistics bench(bool with_writer)
+{
+  using unlocked_table_t = Unlocked<RoutingTable, POLICY>;
+  using clock_type = std::chrono::steady_clock;
+
+  unlocked_table_t table;
+  std::atomic<int> readers_running{number_of_readers};
+  std::atomic<long> writes{0};
+  std::vector<std::vector<double>> latencies(number_of_readers);
+  size_t max_pending_objects = 0;
+
+  // Start without any leftovers from a previous run.
+  EpochDomain::instance().synchronize();
+  EpochDomain::instance().collect();
+
+  std::vector<std::thread> thread_pool;
+  for (int thr = 0; thr < number_of_readers; ++thr)
+    thread_pool.emplace_back([&, thr]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      std::vector<double>& samples(latencies[thr]);
+      samples.reserve(n / sample);
+      unsigned int key = thr;
+      for (int i = 0; i < n; ++i)
+      {
+        key = key * 1103515245 + 12345;
+        clock_type::time_point start;
+        if (i % sample == 0)
+          start = clock_type::now();
+        {
+          typename unlocked_table_t::crat table_r(table);
+          sink = table_r->routes.find(key % table_size)->second;
+        }
+        if (i % sample == 0)
+          samples.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+      }
+      --readers_running;
+    });
+
+  if (with_writer)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      while (readers_running.load(std::memory_order_relaxed) > 0)
+      {
+        {
+          typename unlocked_table_t::wat table_w(table);
+          int version = ++table_w->version;
+          table_w->routes[version % table_size] = version;
+        }
+        ++writes;
+        if constexpr (std::is_same_v<POLICY, policy::RCU>)
+          max_pending_objects = std::max(max_pending_objects, EpochDomain::instance().pending_objects());
+      }
+    });
+
+  for (auto& thread : thread_pool)
+    thread.join();
+
+  std::vector<double> all;
+  for (auto& samples : latencies)
+    all.insert(all.end(), samples.begin(), samples.end());
+  std::sort(all.begin(), all.end());
+  return { all[all.size() / 2], all[all.size() * 99 / 100], all.back(), writes.load(), max_pending_objects };
+}
+
+void print(char const* name, bool with_writer, Statistics const& stats)
+{
+  std::cout << std::left << std::setw(30) << name << std::setw(12) << (with_writer ? "writer" : "no writer") << std::right <<
+    std::fixed << std::setprecision(1) << std::setw(10) << stats.p50_ns << std::setw(10) << stats.p99_ns << std::setw(12) << stats.max_ns <<
+    std::setw(10) << stats.writes;
+  if (with_writer && stats.max_pending_objects > 0)
+    std::cout << "   max pending: " << stats.max_pending_objects << " versions (~" <<
+      stats.max_pending_objects * approximate_version_size / 1024 << " KiB)";
+  std::cout << std::endl;
+}
+
+// The versions retired by the last writes are deleted without another write.
+void test_reclamation()
+{
+  EpochDomain& domain = EpochDomain::instance();
+  bool success;
+  {
+    Unlocked<RoutingTable, policy::RCU> table;
+    for (int version = 1; version <= 3; ++version)
+    {
+      Unlocked<RoutingTable, policy::RCU>::wat table_w(table);
+      table_w->version = version;
+    }
+    // Reading is enough to reclaim them.
+    for (unsigned int i = 0; i < 3 * EpochDomain::collect_interval && domain.pending_objects() != 0; ++i)
+    {
+      Unlocked<RoutingTable, policy::RCU>::crat table_r(table);
+      sink = table_r->version;
+    }
+    success = domain.pending_objects() == 0;
+    {
+      Unlocked<RoutingTable, policy::RCU>::wat table_w(table);
+      table_w->version = 4;
+    }
+    success = success && domain.pending_objects() > 0;
+  }
+  // And so is destroying the table.
+  success = success && domain.pending_objects() == 0;
+  std::cout << "Reclamation: " << (success ? "Success!" : "FAILED!") << std::endl;
+  assert(success);
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_reclamation();
+
+  std::cout << "Running " << number_of_readers << " reader threads, " << n << " reads per thread.\n";
+  std::cout << std::left << std::setw(42) << "policy" << std::right << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns" <<
+    std::setw(12) << "max ns" << std::setw(10) << "writes" << std::endl;
+  for (bool with_writer : { false, true })
+  {
+    print("RCU", with_writer, bench<policy::RCU>(with_writer));
+    print("ReadWrite<AIReadWriteMutex>", with_writer, bench<policy::ReadWrite<AIReadWriteMutex>>(with_writer));
+  }
+  // Everything that was retired must be reclaimable once nobody is pinned anymore.
+  EpochDomain::instance().synchronize();
+  EpochDomain::instance().collect();
+  std::cout << "Pending after synchronize(): " << EpochDomain::instance().pending_objects() << " objects." << std::endl;
+  assert(EpochDomain::instance().pending_objects() == 0);
+}
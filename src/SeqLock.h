@@ -0,0 +1,138 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "ThreadSlot.h"
+
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <thread>
+
+namespace threadsafe {
+namespace policy {
+
+// Sequence lock policy for small, trivially copyable objects.
+//
+// Unlocked<T, policy::SeqLock> keeps a published copy of T next to a sequence
+// number. Read access (crat) takes a snapshot copy of the published data and
+// retries when a writer was active during the copy; readers therefore never
+// write to shared memory. Write access (wat) is serialized by a mutex and gives
+// access to the writer's copy, which is published when the wat is destroyed.
+//
+// Because a crat holds a copy, it is stable: it does not change while it is
+// being looked at, but it also does not block writers. There is no rat to wat
+// conversion; rat is the same as crat.
+struct SeqLock
+{
+};
+
+} // namespace policy
+
+template<typename T>
+class Unlocked<T, policy::SeqLock>
+{
+    static_assert(std::is_trivially_copyable_v<T>, "policy::SeqLock requires a trivially copyable type.");
+
+  public:
+    using data_type = T;
+    using policy_type = policy::SeqLock;
+
+  private:
+    using word_type = std::uintptr_t;
+    static constexpr size_t number_of_words = (sizeof(T) + sizeof(word_type) - 1) / sizeof(word_type);
+
+    alignas(cache_line_size) std::atomic<uint32_t> m_sequence;    // Odd while a writer is publishing.
+    std::atomic<word_type> m_words[number_of_words];              // The published copy of T.
+    alignas(cache_line_size) std::mutex m_writer_mutex;           // Serializes writers.
+    T m_master;                                                   // The writer's copy; only accessed with m_writer_mutex locked.
+
+    // Copy m_master to m_words. Must be called with m_writer_mutex locked (or from the constructor).
+    void publish()
+    {
+      word_type buf[number_of_words] = {};
+      std::memcpy(buf, &m_master, sizeof(T));
+      uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+      m_sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);        // The odd sequence number must be visible before any of the data.
+      for (size_t i = 0; i < number_of_words; ++i)
+        m_words[i].store(buf[i], std::memory_order_relaxed);
+      m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+  public:
+    class crat
+    {
+      private:
+        alignas(T) std::byte m_snapshot[sizeof(T)];
+
+      public:
+        explicit crat(Unlocked const& unlocked)
+        {
+          word_type buf[number_of_words];
+          for (;;)
+          {
+            uint32_t sequence1 = unlocked.m_sequence.load(std::memory_order_acquire);
+            if ((sequence1 & 1))
+            {
+              std::this_thread::yield();
+              continue;
+            }
+            for (size_t i = 0; i < number_of_words; ++i)
+              buf[i] = unlocked.m_words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);    // The data must be read before we re-read the sequence number.
+            uint32_t sequence2 = unlocked.m_sequence.load(std::memory_order_relaxed);
+            if (sequence1 == sequence2)
+              break;
+          }
+          std::memcpy(m_snapshot, buf, sizeof(T));
+        }
+
+        crat(crat const&) = delete;
+        crat& operator=(crat const&) = delete;
+
+        T const* operator->() const { return std::launder(reinterpret_cast<T const*>(m_snapshot)); }
+        T const& operator*() const { return *operator->(); }
+    };
+
+    using rat = crat;
+
+    class wat
+    {
+      private:
+        Unlocked* m_unlocked;
+
+      public:
+        explicit wat(Unlocked& unlocked) : m_unlocked(&unlocked)
+        {
+          m_unlocked->m_writer_mutex.lock();
+        }
+
+        ~wat()
+        {
+          m_unlocked->publish();
+          m_unlocked->m_writer_mutex.unlock();
+        }
+
+        wat(wat const&) = delete;
+        wat& operator=(wat const&) = delete;
+
+        T* operator->() const { return &m_unlocked->m_master; }
+        T& operator*() const { return m_unlocked->m_master; }
+    };
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) : m_sequence(0), m_master(std::forward<ARGS>(args)...)
+    {
+      publish();
+    }
+
+    Unlocked(Unlocked const&) = delete;
+    Unlocked& operator=(Unlocked const&) = delete;
+};
+
+} // namespace threadsafe
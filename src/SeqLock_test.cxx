@@ -0,0 +1,110 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "SeqLock.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Throughput of Unlocked<Doo, policy::SeqLock> versus Unlocked<Doo, policy::ReadWrite<AIReadWriteSpinLock>>
+// at varying write ratios. Every write keeps the invariant x + y == 0, which every read checks.
+
+using namespace threadsafe;
+
+struct Foo {
+  int x;
+};
+
+struct Doo : Foo {
+  int y;
+};
+
+int const number_of_threads = std::max(2U, std::thread::hardware_concurrency());
+int const n = 2000000;
+
+std::atomic<int> ready;
+std::atomic<bool> go;
+std::atomic<long> torn_reads;
+
+template<typename UNLOCKED>
+void run(UNLOCKED& doo, int thr, int write_ratio_ppm)
+{
+  Debug(NAMESPACE_DEBUG::init_thread());
+  uint64_t random = thr * 0x9E3779B97F4A7C15ULL + 1;
+  long torn = 0;
+
+  ++ready;
+  while (!go.load(std::memory_order_acquire))
+    ;
+
+  for (int i = 0; i < n; ++i)
+  {
+    random ^= random >> 12;
+    random ^= random << 25;
+    random ^= random >> 27;
+    if (static_cast<int>((random * 0x2545F4914F6CDD1DULL) % 1000000) < write_ratio_ppm)
+    {
+      typename UNLOCKED::wat doo_w(doo);
+      ++doo_w->x;
+      --doo_w->y;
+    }
+    else
+    {
+      typename UNLOCKED::crat doo_r(doo);
+      if (doo_r->x + doo_r->y != 0)
+        ++torn;
+    }
+  }
+  torn_reads += torn;
+}
+
+template<typename POLICY>
+double bench(int write_ratio_ppm)
+{
+  using unlocked_Doo_t = Unlocked<Doo, POLICY>;
+  unlocked_Doo_t doo;
+  {
+    typename unlocked_Doo_t::wat doo_w(doo);
+    doo_w->x = 0;
+    doo_w->y = 0;
+  }
+
+  ready = 0;
+  go = false;
+  std::vector<std::thread> thread_pool;
+  for (int thr = 0; thr < number_of_threads; ++thr)
+    thread_pool.emplace_back([&doo, thr, write_ratio_ppm]{ run(doo, thr, write_ratio_ppm); });
+  while (ready.load() != number_of_threads)
+    ;
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : thread_pool)
+    thread.join();
+  auto end = std::chrono::steady_clock::now();
+
+  return static_cast<double>(n) * number_of_threads / std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::cout << "Running " << number_of_threads << " threads, " << n << " accesses per thread.\n";
+  std::cout << std::setw(12) << "write ratio" << std::setw(14) << "SeqLock" << std::setw(22) << "AIReadWriteSpinLock" << "   (Mops/s)\n";
+  std::cout << std::fixed << std::setprecision(2);
+  for (int write_ratio_ppm : { 0, 10, 100, 1000, 10000, 100000, 500000 })
+  {
+    double seqlock = bench<policy::SeqLock>(write_ratio_ppm);
+    double spinlock = bench<policy::ReadWrite<AIReadWriteSpinLock>>(write_ratio_ppm);
+    std::cout << std::setw(11) << write_ratio_ppm / 10000.0 << '%' << std::setw(14) << seqlock << std::setw(22) << spinlock << '\n';
+  }
+  std::cout << "Torn reads: " << torn_reads << std::endl;
+  assert(torn_reads == 0);
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "UnlockedLayout.h"
+
+#include <unordered_map>
+#include <functional>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace threadsafe {
+
+// A hash map whose keys are partitioned over number_of_stripes independently
+// locked std::unordered_map's (stripes).
+//
+//   StripedMap<std::string, int> counters;
+//   {
+//     StripedMap<std::string, int>::wat counter_w(counters, "foo");      // Inserts 0 if "foo" doesn't exist.
+//     ++*counter_w;
+//   }
+//   StripedMap<std::string, int>::crat counter_r(counters, "foo");
+//   if (counter_r)
+//     std::cout << *counter_r;
+//
+// An access object locks only the stripe that the key belongs to, so threads
+// that use keys in different stripes never wait for each other. Each stripe
+// grows (rehashes) on its own, while holding only its own write lock; there is
+// never a moment where the whole map is locked.
+//
+// Each stripe is an Unlocked<std::unordered_map<KEY, VALUE, HASH>, POLICY> on its
+// own cache line(s). Pointers into the map are only valid for as long as the
+// access object that returned them exists.
+//
+// Functions that visit all stripes (size, for_each, reserve) lock one stripe at a
+// time and therefore do not see an atomic snapshot of the map.
+template<typename KEY, typename VALUE, typename POLICY = policy::ReadWrite<AIReadWriteMutex>,
+    typename HASH = std::hash<KEY>, std::size_t number_of_stripes = 64>
+class StripedMap
+{
+  static_assert(std::has_single_bit(number_of_stripes), "number_of_stripes must be a power of two.");
+
+  public:
+    using key_type = KEY;
+    using mapped_type = VALUE;
+    using map_type = std::unordered_map<KEY, VALUE, HASH>;
+    using stripe_type = Unlocked<map_type, policy::CacheAligned<POLICY>>;
+
+  private:
+    std::array<stripe_type, number_of_stripes> m_stripes;
+    HASH m_hash;
+
+    static constexpr int stripe_shift = 64 - std::countr_zero(number_of_stripes);
+
+    // Use the high bits of a multiplicative hash, so that the stripe doesn't depend
+    // on the same (low) bits that std::unordered_map uses to pick a bucket, and so
+    // that an identity hash (std::hash<int>) still spreads over all stripes.
+    std::size_t stripe_index(KEY const& key) const
+    {
+      if constexpr (number_of_stripes == 1)
+        return 0;
+      else
+        return (static_cast<uint64_t>(m_hash(key)) * 0x9e3779b97f4a7c15ULL) >> stripe_shift;
+    }
+
+  public:
+    // Read access to the element with a given key.
+    // Converts to false when the key doesn't exist.
+    class crat
+    {
+      private:
+        typename stripe_type::crat m_stripe_r;
+        VALUE const* m_value;
+
+      public:
+        crat(StripedMap const& map, KEY const& key) : m_stripe_r(map.stripe(key))
+        {
+          auto iter = m_stripe_r->find(key);
+          m_value = iter == m_stripe_r->end() ? nullptr : &iter->second;
+        }
+
+        explicit operator bool() const { return m_value; }
+        VALUE const* operator->() const { return m_value; }
+        VALUE const& operator*() const { return *m_value; }
+    };
+
+    // Write access to the element with a given key.
+    // A value initialized element is inserted when the key doesn't exist yet.
+    class wat
+    {
+      private:
+        typename stripe_type::wat m_stripe_w;
+        VALUE* m_value;
+
+      public:
+        wat(StripedMap& map, KEY const& key) : m_stripe_w(map.stripe(key)), m_value(&(*m_stripe_w)[key]) { }
+
+        VALUE* operator->() const { return m_value; }
+        VALUE& operator*() const { return *m_value; }
+    };
+
+    StripedMap() = default;
+    StripedMap(StripedMap const&) = delete;
+    StripedMap& operator=(StripedMap const&) = delete;
+
+    stripe_type& stripe(KEY const& key) { return m_stripes[stripe_index(key)]; }
+    stripe_type const& stripe(KEY const& key) const { return m_stripes[stripe_index(key)]; }
+
+    bool contains(KEY const& key) const
+    {
+      typename stripe_type::crat stripe_r(stripe(key));
+      return stripe_r->contains(key);
+    }
+
+    template<typename... ARGS>
+    bool try_emplace(KEY const& key, ARGS&&... args)
+    {
+      typename stripe_type::wat stripe_w(stripe(key));
+      return stripe_w->try_emplace(key, std::forward<ARGS>(args)...).second;
+    }
+
+    bool erase(KEY const& key)
+    {
+      typename stripe_type::wat stripe_w(stripe(key));
+      return stripe_w->erase(key) > 0;
+    }
+
+    std::size_t size() const
+    {
+      std::size_t total = 0;
+      for (stripe_type const& s : m_stripes)
+        total += typename stripe_type::crat(s)->size();
+      return total;
+    }
+
+    // Make room for at least n elements in total (assuming a uniform hash).
+    void reserve(std::size_t n)
+    {
+      for (stripe_type& s : m_stripes)
+        typename stripe_type::wat(s)->reserve((n + number_of_stripes - 1) / number_of_stripes);
+    }
+
+    // Call func(key, value) for every element, read locking one stripe at a time.
+    template<typename FUNC>
+    void for_each(FUNC func) const
+    {
+      for (stripe_type const& s : m_stripes)
+      {
+        typename stripe_type::crat stripe_r(s);
+        for (auto const& [key, value] : *stripe_r)
+          func(key, value);
+      }
+    }
+};
+
+} // namespace threadsafe
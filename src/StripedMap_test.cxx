@@ -0,0 +1,166 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "StripedMap.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+// StripedMap versus one Unlocked<std::unordered_map> at 1 to 64 threads.
+//
+// Keys are drawn from a Zipf distribution (s = 0.99) over number_of_keys keys,
+// so that a few keys (and therefore a few stripes) are very hot. One in
+// update_ratio operations increments the value of a key (inserting it when it
+// doesn't exist yet), the others look a key up. The sum of all values must
+// equal the number of updates.
+
+using namespace threadsafe;
+
+int constexpr number_of_keys = 100000;
+double constexpr zipf_s = 0.99;
+int constexpr total_ops = 4000000;
+int constexpr update_ratio = 10;
+int constexpr keys_per_thread = 1 << 16;
+
+using striped_map_type = StripedMap<int, long>;
+using unlocked_map_type = Unlocked<std::unordered_map<int, long>, policy::ReadWrite<AIReadWriteMutex>>;
+
+long volatile sink;
+
+struct Random
+{
+  uint64_t m_state;
+  double operator()() { m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL; return (m_state >> 11) * 0x1.0p-53; }
+};
+
+// Cumulative distribution of the Zipf distribution over [0, number_of_keys).
+std::vector<double> zipf_cdf()
+{
+  std::vector<double> cdf(number_of_keys);
+  double sum = 0;
+  for (int k = 0; k < number_of_keys; ++k)
+    cdf[k] = sum += 1.0 / std::pow(k + 1, zipf_s);
+  for (double& c : cdf)
+    c /= sum;
+  return cdf;
+}
+
+// Draw the keys up front, so that the benchmark doesn't measure the random generator.
+std::vector<int> draw_keys(std::vector<double> const& cdf, uint64_t seed)
+{
+  Random random{seed};
+  std::vector<int> keys(keys_per_thread);
+  for (int& key : keys)
+  {
+    int rank = std::lower_bound(cdf.begin(), cdf.end(), random()) - cdf.begin();
+    // Scatter the hot keys, so that they don't all hash to neighbouring values.
+    key = static_cast<int>((static_cast<uint64_t>(std::min(rank, number_of_keys - 1)) * 2654435761U) % 1000003);
+  }
+  return keys;
+}
+
+void update(striped_map_type& map, int key)
+{
+  striped_map_type::wat value_w(map, key);
+  ++*value_w;
+}
+
+void lookup(striped_map_type const& map, int key)
+{
+  striped_map_type::crat value_r(map, key);
+  if (value_r)
+    sink = *value_r;
+}
+
+long total(striped_map_type const& map)
+{
+  long sum = 0;
+  map.for_each([&](int, long value){ sum += value; });
+  return sum;
+}
+
+void update(unlocked_map_type& map, int key)
+{
+  unlocked_map_type::wat map_w(map);
+  ++(*map_w)[key];
+}
+
+void lookup(unlocked_map_type const& map, int key)
+{
+  unlocked_map_type::crat map_r(map);
+  auto iter = map_r->find(key);
+  if (iter != map_r->end())
+    sink = iter->second;
+}
+
+long total(unlocked_map_type const& map)
+{
+  long sum = 0;
+  for (auto const& [key, value] : *unlocked_map_type::crat(map))
+    sum += value;
+  return sum;
+}
+
+template<typename MAP>
+double run(int number_of_threads, std::vector<std::vector<int>> const& keys)
+{
+  MAP map;
+  int const ops = total_ops / number_of_threads;
+  std::atomic<bool> go{false};
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < number_of_threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      std::vector<int> const& my_keys = keys[t];
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      for (int i = 0; i < ops; ++i)
+      {
+        int key = my_keys[i % keys_per_thread];
+        if (i % update_ratio == 0)
+          update(map, key);
+        else
+          lookup(map, key);
+      }
+    });
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : thread_pool)
+    thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  long updates = static_cast<long>(number_of_threads) * ((ops + update_ratio - 1) / update_ratio);
+  assert(total(map) == updates);
+  if (total(map) != updates)
+    std::cout << "Lost updates!" << std::endl;
+  return number_of_threads * ops / seconds / 1e6;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  int constexpr max_threads = 64;
+  std::vector<double> const cdf = zipf_cdf();
+  std::vector<std::vector<int>> keys;
+  for (int t = 0; t < max_threads; ++t)
+    keys.push_back(draw_keys(cdf, t + 1));
+
+  std::cout << "Zipf(" << zipf_s << ") over " << number_of_keys << " keys, " << (100 / update_ratio) << "% updates; Mops/s:" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(14) << "single lock" << std::setw(14) << "StripedMap" << std::endl;
+  for (int number_of_threads = 1; number_of_threads <= max_threads; number_of_threads *= 2)
+  {
+    double single = run<unlocked_map_type>(number_of_threads, keys);
+    double striped = run<striped_map_type>(number_of_threads, keys);
+    std::cout << std::setw(8) << number_of_threads << std::fixed << std::setprecision(2) <<
+      std::setw(14) << single << std::setw(14) << striped << std::endl;
+  }
+}
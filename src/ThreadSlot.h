@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace threadsafe {
+
+// Size of a cache line; used to keep independently written data apart.
+constexpr std::size_t cache_line_size = 64;
+
+// Return a small, stable number for the calling thread.
+//
+// Slots are handed out round-robin on first use and never reused, so callers
+// should reduce the result modulo their own number of shards. Threads that end
+// up in the same shard merely share a counter; the result is still correct.
+inline unsigned int thread_slot()
+{
+  static std::atomic<unsigned int> s_next_slot{0};
+  thread_local unsigned int const t_slot = s_next_slot.fetch_add(1, std::memory_order_relaxed);
+  return t_slot;
+}
+
+// Returned by live_thread_slot() in a thread that already gave its slot back.
+constexpr unsigned int no_live_thread_slot = ~0U;
+
+namespace detail {
+
+constexpr unsigned int unassigned_live_thread_slot = ~0U - 1;
+
+inline unsigned int& live_thread_slot_of_this_thread()
+{
+  thread_local unsigned int t_slot = unassigned_live_thread_slot;
+  return t_slot;
+}
+
+class LiveThreadSlots
+{
+  private:
+    std::mutex m_mutex;
+    std::vector<unsigned int> m_free_slots;     // Protected by m_mutex.
+    unsigned int m_next_slot = 0;               // Protected by m_mutex.
+
+  public:
+    // Never destroyed; threads might exit after static destruction.
+    static LiveThreadSlots& instance()
+    {
+      static LiveThreadSlots* s_slots = new LiveThreadSlots;
+      return *s_slots;
+    }
+
+    unsigned int acquire()
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (m_free_slots.empty())
+        return m_next_slot++;
+      unsigned int slot = m_free_slots.back();
+      m_free_slots.pop_back();
+      return slot;
+    }
+
+    void release(unsigned int slot)
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_free_slots.push_back(slot);
+    }
+};
+
+struct LiveThreadSlotOwner
+{
+  ~LiveThreadSlotOwner()
+  {
+    unsigned int& slot = live_thread_slot_of_this_thread();
+    LiveThreadSlots::instance().release(slot);
+    slot = no_live_thread_slot;
+  }
+};
+
+} // namespace detail
+
+// Return a small number for the calling thread that no other running thread has.
+//
+// Unlike thread_slot(), the slot of a thread is handed out again after that thread
+// exited, so slots stay below the largest number of threads that ran at the same
+// time. Everything that the previous owner of a slot did happens before the next
+// owner gets it, so per-slot data can be updated without atomic read-modify-write
+// operations. During the destruction of its thread_local objects a thread might
+// already have given its slot back; then this returns no_live_thread_slot.
+inline unsigned int live_thread_slot()
+{
+  unsigned int& slot = detail::live_thread_slot_of_this_thread();
+  if (slot == detail::unassigned_live_thread_slot) [[unlikely]]
+  {
+    slot = detail::LiveThreadSlots::instance().acquire();
+    thread_local detail::LiveThreadSlotOwner t_owner;   // Gives the slot back when this thread exits.
+  }
+  return slot;
+}
+
+} // namespace threadsafe
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <bit>
+#include <cstddef>
+#include <utility>
+
+namespace threadsafe {
+namespace detail {
+
+// Pull the tracker of object, if it has one, into the cache ahead of a move.
+// Finding the tracker reads object, so object itself should have been prefetched earlier.
+template<typename T>
+void prefetch_tracker(T& object)
+{
+  if constexpr (requires { object.tracker(); })
+    __builtin_prefetch(&object.tracker(), 1);
+}
+
+} // namespace detail
+
+// A vector for tracked objects (UnlockedTrackedObject) that never relocates its
+// elements when it grows.
+//
+// Moving a tracked object has to lock and update its tracker, so when a
+// std::vector<TFoo> reallocates, every element pays for that, all in the same
+// push_back. TrackedVector stores its elements in fixed size segments instead:
+// growing only allocates a new segment and existing elements (and references
+// to them) stay where they are.
+//
+// Elements are only moved by erase, which shifts the tail down by one in a single
+// pass. The objects 2 * prefetch_distance elements ahead are prefetched, and the
+// trackers prefetch_distance elements ahead (reading the pointer to a tracker then
+// hits the object that was prefetched a stride earlier), so that the per-element
+// tracker updates don't stall on cache misses.
+template<typename T, std::size_t segment_size = 256>
+class TrackedVector
+{
+  static_assert(std::has_single_bit(segment_size), "segment_size must be a power of two.");
+
+  private:
+    static constexpr std::size_t prefetch_distance = 8;
+
+    struct Segment
+    {
+      alignas(T) std::byte m_storage[segment_size * sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Segment>> m_segments;
+    std::size_t m_size = 0;
+
+    T* address(std::size_t i) const
+    {
+      return std::launder(reinterpret_cast<T*>(m_segments[i / segment_size]->m_storage)) + i % segment_size;
+    }
+
+    // Move-construct the element at from into the (destroyed) element at to.
+    void relocate(std::size_t from, std::size_t to)
+    {
+      new (address(to)) T(std::move(*address(from)));
+    }
+
+  public:
+    TrackedVector() = default;
+    TrackedVector(TrackedVector const&) = delete;
+    TrackedVector& operator=(TrackedVector const&) = delete;
+    ~TrackedVector() { clear(); }
+
+    template<typename... ARGS>
+    T& emplace_back(ARGS&&... args)
+    {
+      if (m_size == m_segments.size() * segment_size)
+        m_segments.push_back(std::make_unique<Segment>());
+      T* element = new (address(m_size)) T(std::forward<ARGS>(args)...);
+      ++m_size;
+      return *element;
+    }
+
+    void pop_back()
+    {
+      address(--m_size)->~T();
+    }
+
+    // Destroys all elements, but keeps the allocated segments.
+    void clear()
+    {
+      while (m_size > 0)
+        pop_back();
+    }
+
+    // Remove the element at index i, preserving the order of the remaining elements.
+    void erase(std::size_t i)
+    {
+      address(i)->~T();
+      for (std::size_t j = i; j + 1 < m_size; ++j)
+      {
+        if (j + 1 + 2 * prefetch_distance < m_size)
+          __builtin_prefetch(address(j + 1 + 2 * prefetch_distance), 1);
+        if (j + 1 + prefetch_distance < m_size)
+          detail::prefetch_tracker(*address(j + 1 + prefetch_distance));
+        relocate(j + 1, j);
+        address(j + 1)->~T();
+      }
+      --m_size;
+    }
+
+    // Remove the element at index i by moving the last element into its place.
+    void erase_unordered(std::size_t i)
+    {
+      address(i)->~T();
+      if (i != m_size - 1)
+      {
+        relocate(m_size - 1, i);
+        address(m_size - 1)->~T();
+      }
+      --m_size;
+    }
+
+    T& operator[](std::size_t i) { return *address(i); }
+    T const& operator[](std::size_t i) const { return *address(i); }
+    T& back() { return *address(m_size - 1); }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    std::size_t capacity() const { return m_segments.size() * segment_size; }
+};
+
+} // namespace threadsafe
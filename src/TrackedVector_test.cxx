@@ -0,0 +1,104 @@
+#include "sys.h"
+#include "threadsafe/ObjectTracker.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "threadsafe/ObjectTracker.inl.h"
+#include "TrackedVector.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// TrackedVector versus std::vector for tracked objects.
+//
+// First checks that elements keep their address (and tracker) while the
+// TrackedVector grows, and that erase moves the trackers along with the
+// elements. Then pushes number_of_objects TFoo's into both containers and
+// reports the total time and the slowest single emplace_back, which for
+// std::vector is the one that relocates all elements.
+
+using namespace threadsafe;
+
+int constexpr number_of_objects = 200000;
+
+struct locked_TFoo;
+
+using TFoo = threadsafe::UnlockedTrackedObject<locked_TFoo, threadsafe::policy::ReadWrite<AIReadWriteMutex>>;
+using TFooTracker = threadsafe::ObjectTracker<TFoo, locked_TFoo, threadsafe::policy::ReadWrite<AIReadWriteMutex>>;
+
+struct locked_TFoo : threadsafe::TrackedObject<TFoo, TFooTracker> {
+  int x;
+};
+
+void set_x(TFoo& tfoo, int x)
+{
+  TFoo::wat tfoo_w{tfoo};
+  tfoo_w->x = x;
+}
+
+int get_x(TFoo const& tfoo)
+{
+  TFoo::crat tfoo_r{tfoo};
+  return tfoo_r->x;
+}
+
+void test_tracked_vector()
+{
+  int constexpr n = 1000;
+  TrackedVector<TFoo> tfoos;
+  std::vector<TFoo*> addresses;
+  std::vector<TFooTracker*> trackers;
+  for (int i = 0; i < n; ++i)
+  {
+    TFoo& tfoo = tfoos.emplace_back();
+    set_x(tfoo, i);
+    addresses.push_back(&tfoo);
+    trackers.push_back(&tfoo.tracker());
+  }
+  for (int i = 0; i < n; ++i)
+    assert(&tfoos[i] == addresses[i] && &tfoos[i].tracker() == trackers[i]);
+
+  // Remove x == 10 and x == 20; the last element (x == n - 1) takes the place of 20.
+  tfoos.erase(10);
+  tfoos.erase_unordered(19);
+  assert(tfoos.size() == n - 2);
+  for (int i = 0; i < n - 2; ++i)
+  {
+    int expected_x = i < 10 ? i : i == 19 ? n - 1 : i + 1;
+    assert(get_x(tfoos[i]) == expected_x);
+    assert(&tfoos[i].tracker() == trackers[expected_x]);
+  }
+  std::cout << "TrackedVector: Success!" << std::endl;
+}
+
+template<typename CONTAINER>
+void grow(char const* name)
+{
+  CONTAINER tfoos;
+  std::chrono::steady_clock::duration slowest{};
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < number_of_objects; ++i)
+  {
+    auto before = std::chrono::steady_clock::now();
+    tfoos.emplace_back();
+    slowest = std::max(slowest, std::chrono::steady_clock::now() - before);
+  }
+  auto total = std::chrono::steady_clock::now() - start;
+  std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(2) <<
+    "total " << std::setw(8) << std::chrono::duration<double, std::milli>(total).count() << " ms, slowest emplace_back " <<
+    std::setw(8) << std::chrono::duration<double, std::micro>(slowest).count() << " us" << std::endl;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_tracked_vector();
+
+  std::cout << "Growing to " << number_of_objects << " tracked objects:" << std::endl;
+  grow<std::vector<TFoo>>("std::vector");
+  grow<TrackedVector<TFoo>>("TrackedVector");
+}
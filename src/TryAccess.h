@@ -0,0 +1,184 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "UnlockedAccessor.h"
+
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
+namespace threadsafe {
+
+// Access types that don't block, or block at most until a deadline.
+//
+//   if (auto foo_w = try_wat(foo))
+//     foo_w->x = 42;
+//   else
+//     ...                                       // Somebody else holds the lock; do something else.
+//
+//   auto foo_r = crat_until(foo, std::chrono::steady_clock::now() + 100us);
+//   if (!foo_r)
+//     ...                                       // Gave up after 100 microseconds.
+//
+// The result converts to false when the lock could not be obtained; otherwise
+// it is used like a crat, rat or wat and releases the lock at the end of its scope.
+// A try_rat / rat_until can not be converted into write access; use try_wat
+// or wat_until instead.
+//
+// Supported are Unlocked<T, policy::OneThread> (always succeeds),
+// Unlocked<T, policy::Primitive<M>> where M has try_lock() and try_lock_until()
+// (like std::timed_mutex; the latter is only needed for the *_until variants) and
+// Unlocked<T, policy::ReadWrite<M>> where M has try_rdlock(), try_wrlock(),
+// rdlock_until() and wrlock_until() (AIFutexReadWriteMutex, AIBackoffReadWriteSpinLock).
+
+namespace detail {
+
+// How to try to lock an Unlocked<T, POLICY>.
+template<typename POLICY>
+struct TryLocker;
+
+template<>
+struct TryLocker<policy::OneThread>
+{
+  template<bool writable, typename UNLOCKED>
+  static bool try_lock(UNLOCKED const&) { return true; }
+
+  template<bool writable, typename UNLOCKED, typename TIME_POINT>
+  static bool try_lock_until(UNLOCKED const&, TIME_POINT const&) { return true; }
+
+  template<bool writable, typename UNLOCKED>
+  static void unlock(UNLOCKED const&) { }
+};
+
+// Primitive only has an exclusive lock.
+template<typename MUTEX>
+struct TryLocker<policy::Primitive<MUTEX>>
+{
+  template<bool writable, typename UNLOCKED>
+  static bool try_lock(UNLOCKED const& unlocked)
+  {
+    return UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).try_lock();
+  }
+
+  template<bool writable, typename UNLOCKED, typename TIME_POINT>
+  static bool try_lock_until(UNLOCKED const& unlocked, TIME_POINT const& deadline)
+  {
+    return UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).try_lock_until(deadline);
+  }
+
+  template<bool writable, typename UNLOCKED>
+  static void unlock(UNLOCKED const& unlocked)
+  {
+    UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).unlock();
+  }
+};
+
+template<typename MUTEX>
+struct TryLocker<policy::ReadWrite<MUTEX>>
+{
+  template<bool writable, typename UNLOCKED>
+  static bool try_lock(UNLOCKED const& unlocked)
+  {
+    auto& mutex = UnlockedAccessor<UNLOCKED>::get_mutex(unlocked);
+    return writable ? mutex.try_wrlock() : mutex.try_rdlock();
+  }
+
+  template<bool writable, typename UNLOCKED, typename TIME_POINT>
+  static bool try_lock_until(UNLOCKED const& unlocked, TIME_POINT const& deadline)
+  {
+    auto& mutex = UnlockedAccessor<UNLOCKED>::get_mutex(unlocked);
+    return writable ? mutex.wrlock_until(deadline) : mutex.rdlock_until(deadline);
+  }
+
+  template<bool writable, typename UNLOCKED>
+  static void unlock(UNLOCKED const& unlocked)
+  {
+    auto& mutex = UnlockedAccessor<UNLOCKED>::get_mutex(unlocked);
+    if (writable)
+      mutex.wrunlock();
+    else
+      mutex.rdunlock();
+  }
+};
+
+} // namespace detail
+
+template<typename UNLOCKED>
+concept TryLockableUnlocked = requires { sizeof(detail::TryLocker<typename UNLOCKED::policy_type>); };
+
+// The result of try_crat, try_rat, crat_until and rat_until (writable is false),
+// or of try_wat and wat_until (writable is true).
+template<TryLockableUnlocked UNLOCKED, bool writable>
+class TryAccess
+{
+  public:
+    using data_type = typename UNLOCKED::data_type;
+    using unlocked_type = std::conditional_t<writable, UNLOCKED, UNLOCKED const>;
+    using pointer_type = std::conditional_t<writable, data_type*, data_type const*>;
+
+  private:
+    using locker_type = detail::TryLocker<typename UNLOCKED::policy_type>;
+    unlocked_type* m_unlocked;                  // Null if the lock wasn't obtained.
+
+  public:
+    // Try to obtain the lock once.
+    explicit TryAccess(unlocked_type& unlocked) :
+      m_unlocked(locker_type::template try_lock<writable>(unlocked) ? &unlocked : nullptr) { }
+
+    // Try to obtain the lock until deadline.
+    template<typename CLOCK, typename DURATION>
+    TryAccess(unlocked_type& unlocked, std::chrono::time_point<CLOCK, DURATION> const& deadline) :
+      m_unlocked(locker_type::template try_lock_until<writable>(unlocked, deadline) ? &unlocked : nullptr) { }
+
+    ~TryAccess()
+    {
+      if (m_unlocked)
+        locker_type::template unlock<writable>(*m_unlocked);
+    }
+
+    TryAccess(TryAccess const&) = delete;
+    TryAccess& operator=(TryAccess const&) = delete;
+
+    explicit operator bool() const { return m_unlocked; }
+
+    pointer_type operator->() const { return UnlockedAccessor<UNLOCKED>::get_ptr(*m_unlocked); }
+    auto& operator*() const { return *operator->(); }
+};
+
+template<TryLockableUnlocked UNLOCKED>
+TryAccess<UNLOCKED, false> try_crat(UNLOCKED const& unlocked)
+{
+  return TryAccess<UNLOCKED, false>(unlocked);
+}
+
+template<TryLockableUnlocked UNLOCKED>
+TryAccess<UNLOCKED, false> try_rat(UNLOCKED& unlocked)
+{
+  return TryAccess<UNLOCKED, false>(unlocked);
+}
+
+template<TryLockableUnlocked UNLOCKED>
+TryAccess<UNLOCKED, true> try_wat(UNLOCKED& unlocked)
+{
+  return TryAccess<UNLOCKED, true>(unlocked);
+}
+
+template<TryLockableUnlocked UNLOCKED, typename CLOCK, typename DURATION>
+TryAccess<UNLOCKED, false> crat_until(UNLOCKED const& unlocked, std::chrono::time_point<CLOCK, DURATION> const& deadline)
+{
+  return { unlocked, deadline };
+}
+
+template<TryLockableUnlocked UNLOCKED, typename CLOCK, typename DURATION>
+TryAccess<UNLOCKED, false> rat_until(UNLOCKED& unlocked, std::chrono::time_point<CLOCK, DURATION> const& deadline)
+{
+  return { unlocked, deadline };
+}
+
+template<TryLockableUnlocked UNLOCKED, typename CLOCK, typename DURATION>
+TryAccess<UNLOCKED, true> wat_until(UNLOCKED& unlocked, std::chrono::time_point<CLOCK, DURATION> const& deadline)
+{
+  return { unlocked, deadline };
+}
+
+} // namespace threadsafe
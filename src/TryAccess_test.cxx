@@ -0,0 +1,238 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "AIFutexReadWriteMutex.h"
+#include "AIBackoffReadWriteSpinLock.h"
+#include "TryAccess.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cassert>
+#include <algorithm>
+
+// Checks that try_crat / try_rat / try_wat and crat_until / rat_until / wat_until
+// fail while another thread holds a conflicting lock and succeed otherwise, for
+// every policy. Then measures the tail latency of getting access under a writer
+// heavy load, blocking in rat / wat versus giving up after a deadline.
+
+using namespace threadsafe;
+using namespace std::chrono_literals;
+
+int const number_of_threads = std::max(4U, std::thread::hardware_concurrency());
+int constexpr ops = 20000;
+auto constexpr write_hold = std::chrono::microseconds(5);
+auto constexpr budget = std::chrono::microseconds(50);
+
+struct Foo
+{
+  long x = 0;
+};
+
+using unlocked_Foo_one_thread_t = Unlocked<Foo, policy::OneThread>;
+using unlocked_Foo_primitive_t = Unlocked<Foo, policy::Primitive<std::timed_mutex>>;
+using unlocked_Foo_futex_t = Unlocked<Foo, policy::ReadWrite<AIFutexReadWriteMutex>>;
+using unlocked_Foo_spin_t = Unlocked<Foo, policy::ReadWrite<AIBackoffReadWriteSpinLock<>>>;
+using unlocked_Foo_phase_fair_t = Unlocked<Foo, policy::ReadWrite<AIBackoffReadWriteSpinLock<backoff::SpinThenPark<>, fairness::PhaseFair>>>;
+
+void test_one_thread()
+{
+  unlocked_Foo_one_thread_t foo;
+  {
+    auto foo_w = try_wat(foo);
+    assert(foo_w);
+    foo_w->x = 1;
+  }
+  assert(try_crat(foo)->x == 1);
+  assert(wat_until(foo, std::chrono::steady_clock::now()));
+  std::cout << "OneThread: Success!" << std::endl;
+}
+
+// Runs check() while another thread holds a read (writer is false) or write lock on foo.
+template<bool writer, typename UNLOCKED, typename CHECK>
+void while_locked(UNLOCKED& foo, CHECK check)
+{
+  std::atomic<bool> locked{false};
+  std::atomic<bool> done{false};
+  std::thread holder([&]{
+    Debug(NAMESPACE_DEBUG::init_thread());
+    if constexpr (writer)
+    {
+      typename UNLOCKED::wat foo_w(foo);
+      locked = true;
+      while (!done)
+        std::this_thread::yield();
+    }
+    else
+    {
+      typename UNLOCKED::crat foo_r(foo);
+      locked = true;
+      while (!done)
+        std::this_thread::yield();
+    }
+  });
+  while (!locked)
+    std::this_thread::yield();
+  check();
+  done = true;
+  holder.join();
+}
+
+template<typename UNLOCKED>
+void test_try(std::string const& name, bool shared_reads)
+{
+  UNLOCKED foo;
+
+  while_locked<true>(foo, [&]{
+    assert(!try_wat(foo));
+    assert(!try_rat(foo));
+    assert(!try_crat(foo));
+    auto start = std::chrono::steady_clock::now();
+    assert(!wat_until(foo, start + 20ms));
+    assert(std::chrono::steady_clock::now() - start >= 20ms);
+    assert(!crat_until(foo, std::chrono::system_clock::now() + 1ms));
+  });
+
+  while_locked<false>(foo, [&]{
+    assert(!try_wat(foo));
+    assert(!wat_until(foo, std::chrono::steady_clock::now() + 1ms));
+    assert(static_cast<bool>(try_crat(foo)) == shared_reads);
+    assert(static_cast<bool>(rat_until(foo, std::chrono::steady_clock::now() + 1ms)) == shared_reads);
+  });
+
+  // A writer that gave up must not leave the lock in a state that blocks others.
+  {
+    auto foo_w = wat_until(foo, std::chrono::steady_clock::now() + 1ms);
+    assert(foo_w);
+    foo_w->x = 42;
+  }
+  assert(try_crat(foo)->x == 42);
+  std::cout << name << ": Success!" << std::endl;
+}
+
+thread_local long volatile sink;
+
+void hold(std::chrono::microseconds duration)
+{
+  auto until = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < until)
+    ;
+}
+
+struct Latencies
+{
+  std::vector<double> m_us;     // Time spent obtaining access, in microseconds.
+  long m_gave_up = 0;
+};
+
+// Three out of four accesses are writes. With deadline set, every access gives up after budget.
+template<typename UNLOCKED>
+Latencies run(bool deadline)
+{
+  UNLOCKED foo;
+  std::mutex latencies_mutex;
+  Latencies latencies;
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < number_of_threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      Latencies local;
+      local.m_us.reserve(ops);
+      unsigned int random = t + 1;
+      for (int i = 0; i < ops; ++i)
+      {
+        random = random * 1103515245 + 12345;
+        bool const write = (random >> 8) % 4 != 0;
+        auto start = std::chrono::steady_clock::now();
+        if (write)
+        {
+          if (deadline)
+          {
+            auto foo_w = wat_until(foo, start + budget);
+            local.m_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            if (!foo_w)
+            {
+              ++local.m_gave_up;
+              continue;
+            }
+            ++foo_w->x;
+            hold(write_hold);
+          }
+          else
+          {
+            typename UNLOCKED::wat foo_w(foo);
+            local.m_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            ++foo_w->x;
+            hold(write_hold);
+          }
+        }
+        else
+        {
+          if (deadline)
+          {
+            auto foo_r = crat_until(foo, start + budget);
+            local.m_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            if (!foo_r)
+            {
+              ++local.m_gave_up;
+              continue;
+            }
+            sink = foo_r->x;
+          }
+          else
+          {
+            typename UNLOCKED::crat foo_r(foo);
+            local.m_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            sink = foo_r->x;
+          }
+        }
+      }
+      std::lock_guard<std::mutex> lk(latencies_mutex);
+      latencies.m_us.insert(latencies.m_us.end(), local.m_us.begin(), local.m_us.end());
+      latencies.m_gave_up += local.m_gave_up;
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  std::sort(latencies.m_us.begin(), latencies.m_us.end());
+  return latencies;
+}
+
+void print(std::string const& name, Latencies const& latencies)
+{
+  auto percentile = [&](double p){ return latencies.m_us[std::min(latencies.m_us.size() - 1, static_cast<size_t>(p * latencies.m_us.size()))]; };
+  std::cout << std::setw(40) << std::left << name << std::right << std::fixed << std::setprecision(1) <<
+    std::setw(10) << percentile(0.5) << std::setw(10) << percentile(0.99) << std::setw(10) << percentile(0.999) <<
+    std::setw(12) << latencies.m_us.back() << std::setw(10) << std::setprecision(2) <<
+    100.0 * latencies.m_gave_up / latencies.m_us.size() << std::endl;
+}
+
+template<typename UNLOCKED>
+void benchmark(std::string const& name)
+{
+  print(name + ", blocking", run<UNLOCKED>(false));
+  print(name + ", deadline", run<UNLOCKED>(true));
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_one_thread();
+  test_try<unlocked_Foo_primitive_t>("Primitive<std::timed_mutex>", false);
+  test_try<unlocked_Foo_futex_t>("ReadWrite<AIFutexReadWriteMutex>", true);
+  test_try<unlocked_Foo_spin_t>("ReadWrite<AIBackoffReadWriteSpinLock>", true);
+  test_try<unlocked_Foo_phase_fair_t>("ReadWrite<AIBackoffReadWriteSpinLock<PhaseFair>>", true);
+
+  std::cout << "\nMicroseconds to get access; " << number_of_threads << " threads, 75% writes holding the lock " <<
+    write_hold.count() << " us, deadline " << budget.count() << " us:" << std::endl;
+  std::cout << std::setw(40) << std::left << "" << std::right << std::setw(10) << "p50" << std::setw(10) << "p99" <<
+    std::setw(10) << "p99.9" << std::setw(12) << "max" << std::setw(10) << "gave up%" << std::endl;
+  benchmark<unlocked_Foo_primitive_t>("Primitive<std::timed_mutex>");
+  benchmark<unlocked_Foo_futex_t>("AIFutexReadWriteMutex");
+  benchmark<unlocked_Foo_spin_t>("AIBackoffReadWriteSpinLock");
+}
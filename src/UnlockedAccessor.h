@@ -0,0 +1,48 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+
+namespace threadsafe {
+
+// Access to the protected members of Unlocked / UnlockedBase and of their access types.
+//
+// The access types of threadsafe.h are the only ones that may touch the mutex of
+// an Unlocked object and the object that it wraps. Access types that are not part
+// of threadsafe.h (see for example UpgradeableReadAccess.h) need the same access;
+// this helper provides it by taking the address of the protected members through
+// a derived class, which is allowed, and then applying that member pointer to the
+// original object.
+template<typename UNLOCKED>
+struct UnlockedAccessor : UNLOCKED
+{
+  using data_type = typename UNLOCKED::data_type;
+
+  // Return a reference to the mutex that protects unlocked.
+  static auto& get_mutex(UNLOCKED const& unlocked)
+  {
+    return (unlocked.*(&UnlockedAccessor::mutex))();
+  }
+
+  // Return a pointer to the wrapped object.
+  static data_type* get_ptr(UNLOCKED& unlocked)
+  {
+    return (unlocked.*static_cast<data_type* (UNLOCKED::*)()>(&UnlockedAccessor::ptr))();
+  }
+
+  static data_type const* get_ptr(UNLOCKED const& unlocked)
+  {
+    return (unlocked.*static_cast<data_type const* (UNLOCKED::*)() const>(&UnlockedAccessor::ptr))();
+  }
+};
+
+// Return the Unlocked object that a crat, rat or wat refers to.
+template<typename UNLOCKED>
+struct AccessAccessor : UNLOCKED::crat
+{
+  static UNLOCKED* unlocked(typename UNLOCKED::crat const& access)
+  {
+    return access.*(&AccessAccessor::m_unlocked);
+  }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "threadsafe/threadsafe.h"
+#include "ThreadSlot.h"
+
+#include <utility>
+
+namespace threadsafe {
+namespace policy {
+
+// Layout decorators for Unlocked.
+//
+// By default Unlocked<T, POLICY> packs the mutex and T as tightly as possible,
+// so that in an array of Unlocked objects several locks can share one cache
+// line; threads that lock different elements then still bounce that line
+// between their CPUs (false sharing).
+//
+// Unlocked<T, policy::CacheAligned<POLICY>>
+//   Each object starts at a cache line boundary and its size is rounded up
+//   to a multiple of the cache line size. The mutex and T share the first line.
+//
+// Unlocked<T, policy::Isolated<POLICY>>
+//   Like CacheAligned, and in addition T starts on the next cache line after
+//   the mutex, so that threads spinning on the lock don't disturb threads
+//   that are accessing the data, and vice versa.
+//
+// Both use the crat, rat and wat of Unlocked<T, POLICY>; UnlockedBase is not supported.
+template<typename POLICY>
+struct CacheAligned
+{
+  using policy_type = POLICY;
+};
+
+template<typename POLICY>
+struct Isolated
+{
+  using policy_type = POLICY;
+};
+
+} // namespace policy
+
+template<typename T, typename POLICY>
+class alignas(cache_line_size) Unlocked<T, policy::CacheAligned<POLICY>> : public Unlocked<T, POLICY>
+{
+  public:
+    using base_type = Unlocked<T, POLICY>;
+    using policy_type = policy::CacheAligned<POLICY>;
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) : base_type(std::forward<ARGS>(args)...) { }
+};
+
+namespace detail {
+
+template<typename T>
+struct IsolatedData
+{
+  alignas(cache_line_size) T m_value;
+
+  template<typename... ARGS>
+  explicit IsolatedData(ARGS&&... args) : m_value(std::forward<ARGS>(args)...) { }
+};
+
+} // namespace detail
+
+template<typename T, typename POLICY>
+class Unlocked<T, policy::Isolated<POLICY>> : public Unlocked<detail::IsolatedData<T>, POLICY>
+{
+  public:
+    using base_type = Unlocked<detail::IsolatedData<T>, POLICY>;
+    using data_type = T;
+    using policy_type = policy::Isolated<POLICY>;
+
+    class crat : public base_type::crat
+    {
+      public:
+        explicit crat(Unlocked const& unlocked) : base_type::crat(unlocked) { }
+
+        T const* operator->() const { return &base_type::crat::operator->()->m_value; }
+        T const& operator*() const { return *operator->(); }
+    };
+
+    class rat : public base_type::rat
+    {
+      public:
+        explicit rat(Unlocked& unlocked) : base_type::rat(unlocked) { }
+
+        T const* operator->() const { return &base_type::rat::operator->()->m_value; }
+        T const& operator*() const { return *operator->(); }
+    };
+
+    class wat : public base_type::wat
+    {
+      public:
+        explicit wat(Unlocked& unlocked) : base_type::wat(unlocked) { }
+        explicit wat(rat& read_access) : base_type::wat(read_access) { }
+
+        T* operator->() const { return &base_type::wat::operator->()->m_value; }
+        T& operator*() const { return *operator->(); }
+    };
+
+    template<typename... ARGS>
+    explicit Unlocked(ARGS&&... args) : base_type(std::forward<ARGS>(args)...) { }
+
+  protected:
+    // Used by UnlockedAccessor.
+    T* ptr() { return &base_type::ptr()->m_value; }
+    T const* ptr() const { return &base_type::ptr()->m_value; }
+};
+
+} // namespace threadsafe
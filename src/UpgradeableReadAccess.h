@@ -0,0 +1,146 @@
+#pragma once
+
+#include "UnlockedAccessor.h"
+#include <utility>
+#include <cassert>
+
+namespace threadsafe {
+
+// The mutex of UNLOCKED supports an upgradeable read lock (see AIUpgradeableReadWriteMutex).
+template<typename UNLOCKED>
+concept UpgradeableUnlocked = requires(UNLOCKED const& unlocked)
+{
+  UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).urlock();
+  UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).ur2wrlock();
+  UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).try_rd2wrlock();
+};
+
+template<UpgradeableUnlocked UNLOCKED>
+class UpgradedWriteAccess;
+
+// Upgradeable read access (urat).
+//
+// Gives read access, like a rat, while other threads can still obtain crat and rat
+// access to the same object. Only one thread at a time can have upgradeable access.
+// Unlike converting a rat to a wat, converting this access type to write access
+// (by constructing an UpgradedWriteAccess from it) never fails.
+//
+// Works with Unlocked<T, policy::ReadWrite<M>> and UnlockedBase<T, policy::ReadWrite<M>>
+// (ReadWriteRef) where M is AIUpgradeableReadWriteMutex.
+//
+//   Unlocked<Foo, policy::ReadWrite<AIUpgradeableReadWriteMutex>> foo;
+//   UpgradeableReadAccess foo_u(foo);
+//   if (foo_u->x == 0)
+//   {
+//     UpgradedWriteAccess foo_w(foo_u);
+//     foo_w->x = 1;
+//   }
+template<UpgradeableUnlocked UNLOCKED>
+class UpgradeableReadAccess
+{
+  public:
+    using data_type = typename UNLOCKED::data_type;
+
+  private:
+    friend class UpgradedWriteAccess<UNLOCKED>;
+    UNLOCKED* m_unlocked;
+
+  public:
+    explicit UpgradeableReadAccess(UNLOCKED& unlocked) : m_unlocked(&unlocked)
+    {
+      UnlockedAccessor<UNLOCKED>::get_mutex(unlocked).urlock();
+    }
+
+    ~UpgradeableReadAccess()
+    {
+      UnlockedAccessor<UNLOCKED>::get_mutex(*m_unlocked).urunlock();
+    }
+
+    UpgradeableReadAccess(UpgradeableReadAccess const&) = delete;
+    UpgradeableReadAccess& operator=(UpgradeableReadAccess const&) = delete;
+
+    data_type const* operator->() const { return UnlockedAccessor<UNLOCKED>::get_ptr(std::as_const(*m_unlocked)); }
+    data_type const& operator*() const { return *operator->(); }
+};
+
+// Write access obtained from an upgradeable read access.
+// Upon destruction the lock is converted back into the upgradeable read lock.
+template<UpgradeableUnlocked UNLOCKED>
+class UpgradedWriteAccess
+{
+  public:
+    using data_type = typename UNLOCKED::data_type;
+
+  private:
+    UNLOCKED* m_unlocked;
+
+  public:
+    explicit UpgradedWriteAccess(UpgradeableReadAccess<UNLOCKED>& upgradeable_access) : m_unlocked(upgradeable_access.m_unlocked)
+    {
+      UnlockedAccessor<UNLOCKED>::get_mutex(*m_unlocked).ur2wrlock();
+    }
+
+    ~UpgradedWriteAccess()
+    {
+      UnlockedAccessor<UNLOCKED>::get_mutex(*m_unlocked).wr2urlock();
+    }
+
+    UpgradedWriteAccess(UpgradedWriteAccess const&) = delete;
+    UpgradedWriteAccess& operator=(UpgradedWriteAccess const&) = delete;
+
+    data_type* operator->() const { return UnlockedAccessor<UNLOCKED>::get_ptr(*m_unlocked); }
+    data_type& operator*() const { return *operator->(); }
+};
+
+// Non-throwing conversion of a rat into write access.
+//
+// Where `typename UNLOCKED::wat wat(rat)` throws when another thread is already
+// converting its read access, this access type simply evaluates to false.
+// In that case the caller should destroy the rat, call rd2wryield() on the
+// Unlocked object and try again, as usual.
+//
+//   for (;;)
+//   {
+//     {
+//       unlocked_Foo_t::rat foo_r(foo);
+//       TryWriteAccess<unlocked_Foo_t> foo_w(foo_r);
+//       if (foo_w)
+//       {
+//         foo_w->x = 1;
+//         break;
+//       }
+//     }
+//     foo.rd2wryield();
+//   }
+template<UpgradeableUnlocked UNLOCKED>
+class TryWriteAccess
+{
+  public:
+    using data_type = typename UNLOCKED::data_type;
+
+  private:
+    UNLOCKED* m_unlocked;
+    bool m_locked;
+
+  public:
+    explicit TryWriteAccess(typename UNLOCKED::rat& read_access) :
+      m_unlocked(AccessAccessor<UNLOCKED>::unlocked(read_access)),
+      m_locked(UnlockedAccessor<UNLOCKED>::get_mutex(*m_unlocked).try_rd2wrlock()) { }
+
+    ~TryWriteAccess()
+    {
+      // Return the rat in the read locked state, just like a wat that was created from a rat.
+      if (m_locked)
+        UnlockedAccessor<UNLOCKED>::get_mutex(*m_unlocked).wr2rdlock();
+    }
+
+    TryWriteAccess(TryWriteAccess const&) = delete;
+    TryWriteAccess& operator=(TryWriteAccess const&) = delete;
+
+    explicit operator bool() const { return m_locked; }
+
+    data_type* operator->() const { assert(m_locked); return UnlockedAccessor<UNLOCKED>::get_ptr(*m_unlocked); }
+    data_type& operator*() const { return *operator->(); }
+};
+
+} // namespace threadsafe
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "LogLinearBuckets.h"
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+
+namespace threadsafe {
+
+// Thread-safe distribution of wait times, in nanoseconds.
+//
+// Values are counted in log-linear buckets: eight buckets per power of two,
+// so percentiles are accurate to within 12.5%. The maximum is exact.
+class WaitStatistics
+{
+  private:
+    using buckets_type = LogLinearBuckets<3>;
+    static constexpr int number_of_buckets = buckets_type::number_of_buckets;
+
+    std::array<std::atomic<uint64_t>, number_of_buckets> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_total_ns{0};
+    std::atomic<uint64_t> m_max_ns{0};
+
+  public:
+    void record(uint64_t ns)
+    {
+      m_buckets[buckets_type::bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_total_ns.fetch_add(ns, std::memory_order_relaxed);
+      uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+      while (ns > max_ns && !m_max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed))
+        ;
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max_ns() const { return m_max_ns.load(std::memory_order_relaxed); }
+    double mean_ns() const { uint64_t n = count(); return n == 0 ? 0.0 : static_cast<double>(m_total_ns.load(std::memory_order_relaxed)) / n; }
+
+    // The wait time that fraction (0...1) of all waits did not exceed.
+    uint64_t percentile_ns(double fraction) const
+    {
+      uint64_t const n = count();
+      if (n == 0)
+        return 0;
+      uint64_t const rank = std::max(uint64_t{1}, static_cast<uint64_t>(fraction * n + 0.5));
+      uint64_t seen = 0;
+      for (int index = 0; index < number_of_buckets; ++index)
+        if ((seen += m_buckets[index].load(std::memory_order_relaxed)) >= rank)
+          return std::min(buckets_type::upper_bound(index), max_ns());
+      return max_ns();
+    }
+
+    void reset()
+    {
+      for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+      m_count.store(0, std::memory_order_relaxed);
+      m_total_ns.store(0, std::memory_order_relaxed);
+      m_max_ns.store(0, std::memory_order_relaxed);
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, WaitStatistics const& statistics)
+    {
+      return os << statistics.count() << " waits, p50: " << statistics.percentile_ns(0.5) << " ns, p99: " <<
+        statistics.percentile_ns(0.99) << " ns, max: " << statistics.max_ns() << " ns";
+    }
+};
+
+} // namespace threadsafe
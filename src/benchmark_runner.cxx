@@ -0,0 +1,288 @@
+#include "sys.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "AIEventCount.h"
+#include "BenchmarkBaseline.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// Runs the lock and notify benchmarks a number of times and compares the samples
+// with a stored baseline; exits with 1 when a benchmark became significantly slower.
+//
+// Usage: benchmark_runner [--baseline FILE] [--update] [--label TEXT] [--samples N] [--alpha P] [--tolerance PERCENT]
+//
+//   --baseline FILE        The JSON baseline (default benchmark_baseline.json).
+//   --update               Store the results as the new baseline instead of comparing.
+//   --label TEXT           Stored with --update; for example the commit of the threadsafe submodule.
+//   --samples N            The number of samples per benchmark (default 15).
+//   --alpha P              The significance level of the Mann-Whitney U test (default 0.01).
+//   --tolerance PERCENT    Ignore significant slowdowns of the median smaller than this (default 10).
+//
+// Exit codes: 0 no regressions, 1 regressions, 2 error (for example, no baseline).
+//
+// A baseline only means something on the machine that it was recorded on; record one per machine.
+
+using namespace threadsafe;
+using clock_type = std::chrono::steady_clock;
+
+// A benchmark runs iterations operations and returns the number of nanoseconds per operation.
+struct Benchmark
+{
+  std::string m_name;
+  std::function<double(long)> m_run;
+};
+
+template<typename FUNCTION>
+double time_per_op(long iterations, FUNCTION function)
+{
+  auto start = clock_type::now();
+  for (long i = 0; i < iterations; ++i)
+    function();
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / iterations;
+}
+
+AIReadWriteSpinLock spin_locks[2];
+AIReadWriteMutex mutexes[2];
+
+// Measure a[0] while other threads hammer its neighbor a[1] (as bench_run in AIReadWriteSpinLock_test.cxx).
+template<typename LOCK>
+double rdlock_with_neighbors(LOCK* a, long iterations)
+{
+  int const neighbors = std::max(1U, std::thread::hardware_concurrency()) - 1;
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < neighbors; ++t)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        a[1].rdlock();
+        a[1].rdunlock();
+      }
+    });
+  double ns = time_per_op(iterations, [a]{ a[0].rdlock(); a[0].rdunlock(); });
+  stop = true;
+  for (auto& thread : thread_pool)
+    thread.join();
+  return ns;
+}
+
+// Two threads take turns; every turn is a notify and a wake up.
+double ping_pong_event_count(long iterations)
+{
+  AIEventCount events;
+  std::atomic<long> turn{0};
+  auto wait_for = [&](long value){
+    while (turn.load(std::memory_order_acquire) != value)
+    {
+      AIEventCount::Key key = events.prepare_wait();
+      if (turn.load(std::memory_order_acquire) == value)
+      {
+        events.cancel_wait();
+        break;
+      }
+      events.commit_wait(key);
+    }
+  };
+  auto pass = [&](long value){
+    turn.store(value, std::memory_order_release);
+    events.notify_all();
+  };
+  std::thread partner([&]{
+    Debug(NAMESPACE_DEBUG::init_thread());
+    for (long i = 0; i < iterations; ++i)
+    {
+      wait_for(2 * i + 1);
+      pass(2 * i + 2);
+    }
+  });
+  auto start = clock_type::now();
+  for (long i = 0; i < iterations; ++i)
+  {
+    pass(2 * i + 1);
+    wait_for(2 * i + 2);
+  }
+  double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / iterations;
+  partner.join();
+  return ns;
+}
+
+double ping_pong_condition_variable(long iterations)
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  long turn = 0;
+  auto wait_for = [&](long value){
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&]{ return turn == value; });
+  };
+  auto pass = [&](long value){
+    {
+      std::lock_guard<std::mutex> lk(mutex);
+      turn = value;
+    }
+    cv.notify_all();
+  };
+  std::thread partner([&]{
+    Debug(NAMESPACE_DEBUG::init_thread());
+    for (long i = 0; i < iterations; ++i)
+    {
+      wait_for(2 * i + 1);
+      pass(2 * i + 2);
+    }
+  });
+  auto start = clock_type::now();
+  for (long i = 0; i < iterations; ++i)
+  {
+    pass(2 * i + 1);
+    wait_for(2 * i + 2);
+  }
+  double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / iterations;
+  partner.join();
+  return ns;
+}
+
+AIEventCount idle_event_count;
+std::condition_variable idle_cv;
+
+std::vector<Benchmark> const benchmarks = {
+  { "AIReadWriteSpinLock rdlock", [](long n){ return time_per_op(n, []{ spin_locks[0].rdlock(); spin_locks[0].rdunlock(); }); } },
+  { "AIReadWriteSpinLock wrlock", [](long n){ return time_per_op(n, []{ spin_locks[0].wrlock(); spin_locks[0].wrunlock(); }); } },
+  { "AIReadWriteSpinLock rdlock, busy neighbor", [](long n){ return rdlock_with_neighbors(spin_locks, n); } },
+  { "AIReadWriteMutex rdlock", [](long n){ return time_per_op(n, []{ mutexes[0].rdlock(); mutexes[0].rdunlock(); }); } },
+  { "AIReadWriteMutex wrlock", [](long n){ return time_per_op(n, []{ mutexes[0].wrlock(); mutexes[0].wrunlock(); }); } },
+  { "AIReadWriteMutex rdlock, busy neighbor", [](long n){ return rdlock_with_neighbors(mutexes, n); } },
+  { "AIEventCount notify_one, no waiters", [](long n){ return time_per_op(n, []{ idle_event_count.notify_one(); }); } },
+  { "std::condition_variable notify_one, no waiters", [](long n){ return time_per_op(n, []{ idle_cv.notify_one(); }); } },
+  { "AIEventCount ping-pong", ping_pong_event_count },
+  { "std::condition_variable ping-pong", ping_pong_condition_variable }
+};
+
+// Return the number of iterations for which a sample of benchmark takes at least 5 ms.
+long calibrate(Benchmark const& benchmark)
+{
+  long iterations = 100;
+  while (iterations < (1L << 30) && benchmark.m_run(iterations) * iterations < 5e6)
+    iterations *= 2;
+  return iterations;
+}
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::string baseline_path = "benchmark_baseline.json";
+  std::string label;
+  bool update = false;
+  int number_of_samples = 15;
+  double alpha = 0.01;
+  double tolerance = 10.0;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string const arg = argv[i];
+    bool const has_value = i + 1 < argc;
+    if (arg == "--update")
+      update = true;
+    else if (arg == "--baseline" && has_value)
+      baseline_path = argv[++i];
+    else if (arg == "--label" && has_value)
+      label = argv[++i];
+    else if (arg == "--samples" && has_value)
+      number_of_samples = std::max(2, std::atoi(argv[++i]));
+    else if (arg == "--alpha" && has_value)
+      alpha = std::atof(argv[++i]);
+    else if (arg == "--tolerance" && has_value)
+      tolerance = std::atof(argv[++i]);
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--baseline FILE] [--update] [--label TEXT] [--samples N] [--alpha P] [--tolerance PERCENT]" << std::endl;
+      return 2;
+    }
+  }
+
+  benchmark::Baseline baseline;
+  if (!update)
+  {
+    try
+    {
+      baseline.load(baseline_path);
+    }
+    catch (std::exception const& error)
+    {
+      std::cerr << error.what() << "\nRun with --update to create a baseline." << std::endl;
+      return 2;
+    }
+  }
+
+  char hostname[256] = {};
+  gethostname(hostname, sizeof(hostname) - 1);
+  if (!update && !baseline.m_host.empty() && baseline.m_host != hostname)
+    std::cerr << "Warning: the baseline was recorded on " << baseline.m_host << ", this is " << hostname << "." << std::endl;
+
+  benchmark::Baseline results;
+  results.m_label = label;
+  results.m_host = hostname;
+  int regressions = 0;
+  std::cout << std::setw(48) << std::left << "benchmark" << std::right << std::setw(12) << "baseline" << std::setw(12) << "current" <<
+    std::setw(10) << "change" << std::setw(10) << "p" << "  verdict" << std::endl;
+  // Take the samples round-robin, so that a slow drift of the machine's speed affects all benchmarks alike.
+  std::vector<long> iterations;
+  for (Benchmark const& benchmark : benchmarks)
+    iterations.push_back(calibrate(benchmark));
+  for (int s = 0; s < number_of_samples; ++s)
+    for (size_t b = 0; b < benchmarks.size(); ++b)
+      results.m_benchmarks[benchmarks[b].m_name].push_back(benchmarks[b].m_run(iterations[b]));
+  for (Benchmark const& benchmark : benchmarks)
+  {
+    benchmark::Samples const& samples = results.m_benchmarks[benchmark.m_name];
+    double const current = benchmark::median(samples);
+    std::cout << std::setw(48) << std::left << benchmark.m_name << std::right << std::fixed << std::setprecision(1);
+    auto base = baseline.m_benchmarks.find(benchmark.m_name);
+    if (update || base == baseline.m_benchmarks.end())
+    {
+      std::cout << std::setw(12) << "-" << std::setw(12) << current << (update ? "" : "                      new") << std::endl;
+      continue;
+    }
+    double const reference = benchmark::median(base->second);
+    double const change = 100.0 * (current - reference) / reference;
+    double const p = benchmark::mann_whitney_p_greater(base->second, samples);
+    bool const regression = p < alpha && change > tolerance;
+    if (regression)
+      ++regressions;
+    std::cout << std::setw(12) << reference << std::setw(12) << current << std::setw(9) << std::showpos << change << std::noshowpos <<
+      '%' << std::setw(10) << std::setprecision(4) << p << (regression ? "  REGRESSION" : "  ok") << std::endl;
+  }
+
+  if (update)
+  {
+    try
+    {
+      results.save(baseline_path);
+    }
+    catch (std::exception const& error)
+    {
+      std::cerr << error.what() << std::endl;
+      return 2;
+    }
+    std::cout << "Wrote " << baseline_path << std::endl;
+    return 0;
+  }
+  std::cout << regressions << " regression(s) compared to baseline " << baseline_path;
+  if (!baseline.m_label.empty())
+    std::cout << " (" << baseline.m_label << ")";
+  std::cout << '.' << std::endl;
+  return regressions ? 1 : 0;
+}
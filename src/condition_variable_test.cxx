@@ -1,30 +1,56 @@
+#include "AIEventCount.h"
+#include "PerfCounters.h"
+#include "CpuTopology.h"
+
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <string>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
 #include <cmath>
 #include <iomanip>
+#include <algorithm>
+
+// Measure what producer threads pay for waking up consumer threads.
+//
+// Modes:
+//   direct     - Producers call cv.notify_one() every time.
+//   idle       - Consumers count themselves in s_idle before waiting on cv; producers only
+//                call notify_one() when that counter is non-zero.
+//   eventcount - The same idea, packaged as AIEventCount (futex based, no mutex).
+//
+// Usage: condition_variable_test [--placement NAME|all]... [--cpus LIST]... [direct|idle|eventcount]... (default: all three modes).
+//
+// Every mode is run for every given placement of the threads (see CpuTopology::placement:
+// packed, spread, same-core, same-cluster or across-packages) and for every given list of
+// CPUs (for example 0,2,4-7), one thread per CPU: the first half are the producers.
+// Without --placement or --cpus the threads are not pinned.
+//
+// Next to the timings, every producer prints its performance counters per iteration (see PerfCounters.h).
 
-#ifndef DIRECT
-#define DIRECT 0
-#endif
+enum Mode { direct, idle, eventcount };
+char const* mode_names[] = { "direct", "idle", "eventcount" };
 
-int const number_of_threads = std::thread::hardware_concurrency();
-#if DIRECT
-int constexpr n0 = 200000;
-#else
-int constexpr n0 = 150000000;
-#endif
+int const default_number_of_threads = std::max(2U, std::thread::hardware_concurrency());
+int number_of_threads;
+std::vector<int> placement_cpus;                                // The CPUs that the threads are pinned to, or empty.
 int constexpr sn = 25;
 int constexpr cache_linesize = 64;
 int constexpr max_align = alignof(std::max_align_t);
 int constexpr cache_line_dist = cache_linesize / max_align;
 
+int iterations(Mode mode)
+{
+  // Calling notify_one() every time is so slow that we have to do a lot less iterations.
+  return mode == direct ? 200000 : 150000000;
+}
+
 // This doesn't seem to matter that much, but for the sake of precision,
 // put all atomic variables in different cache lines.
 alignas(std::max_align_t) std::atomic<int> thr_count;
@@ -38,25 +64,46 @@ std::max_align_t seperation6[cache_line_dist - 1];              // Put 48 bytes
 alignas(std::max_align_t) std::atomic<int> notify_one_calls{0};
 std::max_align_t seperation7[cache_line_dist - 1];              // Put 48 bytes in between.
 alignas(std::max_align_t) std::atomic_bool finished{false};
+std::max_align_t seperation8[cache_line_dist - 1];              // Put 48 bytes in between.
+alignas(std::max_align_t) AIEventCount event_count;
+std::max_align_t seperation9[cache_line_dist - 1];              // Put 48 bytes in between.
+alignas(std::max_align_t) std::atomic<int> producers_running;
 std::mutex cout_mutex;
+double sum_avg_ns;                                              // Protected by cout_mutex.
+threadsafe::PerfCounters::Counts sum_counts;                    // Protected by cout_mutex.
 
-// Benchmark bench_mark0 when called by four thread, while four other threads call bench_mark1.
-void bench_run()
+// The second half of the threads continuously wait, while the first half benchmark waking them up.
+void bench_run(Mode mode)
 {
   int thr = ++thr_count;
+  int const n0 = iterations(mode);
+  if (!placement_cpus.empty())
+    threadsafe::CpuTopology::pin_current_thread(placement_cpus[(thr - 1) % placement_cpus.size()]);
 
   // Spin until all threads have started.
   while (thr_count.load() != number_of_threads)
     ;
 
-  // The first four threads continuously wait for cv.
   if (thr > number_of_threads / 2)
   {
     while (!finished.load(std::memory_order_relaxed))
     {
       //======================================================================
       // CONSUMER THREADS.
+      if (mode == eventcount)
+      {
+        AIEventCount::Key key = event_count.prepare_wait();
+        if (finished.load(std::memory_order_relaxed))
+        {
+          event_count.cancel_wait();
+          break;
+        }
+        event_count.commit_wait(key);
+        continue;
+      }
       std::unique_lock<std::mutex> lk(m);                       // Atomically increment s_idle and go into the wait state.
+      if (finished.load(std::memory_order_relaxed))
+        break;
       s_idle.fetch_add(1, std::memory_order_relaxed);           // Requirement: threads seeing this increment also must see the mutex being locked.
       cv.wait(lk);
       //======================================================================
@@ -95,11 +142,15 @@ void bench_run()
       // showing that if the second thread sees the value 1
       // stored by the first thread, then it will never be
       // able to obtain the lock on m.
+      //
+      // AIEventCount gives the same guarantee without a mutex; see AIEventCount.h.
     }
   }
   else
   {
     double measurements[sn];
+    threadsafe::PerfCounters counters;
+    counters.start();
     for (int s = 0; s < sn; ++s)
     {
       auto start = std::chrono::high_resolution_clock::now();
@@ -107,28 +158,40 @@ void bench_run()
       {
         //==========================================================================
         // PRODUCER THREADS.
-#if DIRECT
-        cv.notify_one();
-#else
-        int waiting;
-        while ((waiting = s_idle.load(std::memory_order_relaxed)) > 0)        // This line takes 0.9...0.97 ns.
+        switch (mode)
         {
-          if (!s_idle.compare_exchange_weak(waiting, waiting - 1, std::memory_order_relaxed, std::memory_order_relaxed))
-            continue;
-          notify_one_calls.fetch_add(1, std::memory_order_relaxed);           // Count the number of times we get here.
-          // Taking this lock is only necessary when waiting == 1,
-          // but adding a test for that makes things only 1% slower
-          // due to branch misprediction.
-          std::unique_lock<std::mutex> lk(m);
-          cv.notify_one();                                                    // This lines turns out to take 19.5 microseconds!
-          break;
+          case direct:
+            cv.notify_one();
+            break;
+          case idle:
+          {
+            int waiting;
+            while ((waiting = s_idle.load(std::memory_order_relaxed)) > 0)    // This line takes 0.9...0.97 ns.
+            {
+              if (!s_idle.compare_exchange_weak(waiting, waiting - 1, std::memory_order_relaxed, std::memory_order_relaxed))
+                continue;
+              notify_one_calls.fetch_add(1, std::memory_order_relaxed);       // Count the number of times we get here.
+              // Taking this lock is only necessary when waiting == 1,
+              // but adding a test for that makes things only 1% slower
+              // due to branch misprediction.
+              std::unique_lock<std::mutex> lk(m);
+              cv.notify_one();                                                // This lines turns out to take 19.5 microseconds!
+              break;
+            }
+            break;
+          }
+          case eventcount:
+            if (event_count.notify_one())
+              notify_one_calls.fetch_add(1, std::memory_order_relaxed);
+            break;
         }
         //==========================================================================
-#endif
       }
       auto end = std::chrono::high_resolution_clock::now();
       measurements[s] = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
     }
+    counters.stop();
+    threadsafe::PerfCounters::Counts const counts = counters.read();
     double sum_us = 0;
     double min_us = 1e30;
     double max_us = 0.0;
@@ -155,34 +218,116 @@ void bench_run()
     std::streamsize old_precision = std::cout.precision(2);
     std::cout << "Thread " << thr << " statistics: avg: " << std::fixed << avg_ns << "ns, min: " << min_ns << "ns, max: " << max_ns << "ns, stddev: " << stddev_ns << "ns\n";
     std::cout.precision(old_precision);
+    std::cout << std::setw(34) << std::left << "Thread " + std::to_string(thr) + " counters per iteration:" << std::right;
+    threadsafe::PerfCounters::print(std::cout, counts, (double)sn * n0);
+    std::cout << '\n';
+    sum_avg_ns += avg_ns;
+    sum_counts += counts;
+    lk.unlock();
 
-    std::cout << "The average time spent on calling notify_one() (";
-#if DIRECT
-    std::cout << ((uint64_t)sn * n0 * number_of_threads / 2);
-#else
-    std::cout << notify_one_calls;
-#endif
-    std::cout << " calls) was: ";
-#if DIRECT
-    std::cout << avg_ns;
-#else
-    std::cout << (avg_ns - stddev_ns - 0.97) * 4 * n0 * sn / notify_one_calls << " - " << (avg_ns + stddev_ns - 0.90) * 4 * n0 * sn / notify_one_calls;
-#endif
-    std::cout << " ns.\n";
-
-    finished = true;
+    // The last producer to finish releases the consumers.
+    if (--producers_running == 0)
+    {
+      finished = true;
+      if (mode == eventcount)
+        event_count.notify_all();
+      else
+      {
+        // Consumers test finished while holding m, before they wait.
+        { std::lock_guard<std::mutex> lk(m); }
+        cv.notify_all();
+      }
+    }
   }
-  std::cout << "Thread " << thr << " finished." << std::endl;
 }
 
-int main()
+// Run one mode and print the average cost of one producer iteration.
+void run(Mode mode)
 {
+  thr_count = 0;
+  s_idle = 0;
+  notify_one_calls = 0;
+  finished = false;
+  producers_running = number_of_threads / 2;
+  sum_avg_ns = 0;
+  sum_counts = {};
+
+  std::cout << std::setw(34) << std::left << "Mode " + std::string(mode_names[mode]) + ":" << std::right;
+  threadsafe::PerfCounters::print_header(std::cout);
+  std::cout << std::endl;
   std::vector<std::thread> thread_pool;
   for (int i = 0; i < number_of_threads; ++i)
-    thread_pool.emplace(thread_pool.end(), bench_run);
-  std::cout << "All started!" << std::endl;
-
+    thread_pool.emplace(thread_pool.end(), bench_run, mode);
   for (int i = 0; i < number_of_threads; ++i)
     thread_pool[i].join();
-  std::cout << "All finished!" << std::endl;
+
+  int const number_of_producers = number_of_threads / 2;
+  uint64_t const total_iterations = (uint64_t)sn * iterations(mode) * number_of_producers;
+  uint64_t const calls = mode == direct ? total_iterations : notify_one_calls.load();
+  std::cout << "Average time per producer iteration: " << std::fixed << std::setprecision(2) << (sum_avg_ns / number_of_producers) <<
+    " ns; " << calls << " out of " << total_iterations << " iterations made a notify call." << std::endl;
+  std::cout << std::setw(34) << std::left << "Counters per producer iteration:" << std::right;
+  threadsafe::PerfCounters::print(std::cout, sum_counts, (double)total_iterations);
+  std::cout << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  using threadsafe::CpuTopology;
+  CpuTopology const& topology = CpuTopology::instance();
+  std::vector<Mode> modes;
+  std::vector<std::pair<std::string, std::vector<int>>> placements;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--placement") == 0 && i + 1 < argc)
+    {
+      std::string const name = argv[++i];
+      std::size_t const size = placements.size();
+      for (int p = 0; p < CpuTopology::number_of_placements; ++p)
+        if (name == "all" || name == CpuTopology::placement_names[p])
+          placements.emplace_back(CpuTopology::placement_names[p], topology.placement(static_cast<CpuTopology::Placement>(p), default_number_of_threads));
+      if (placements.size() > size)
+        continue;
+    }
+    else if (std::strcmp(argv[i], "--cpus") == 0 && i + 1 < argc && !CpuTopology::parse_cpu_list(argv[i + 1]).empty())
+    {
+      placements.emplace_back(std::string("cpus ") + argv[i + 1], CpuTopology::parse_cpu_list(argv[i + 1]));
+      ++i;
+      continue;
+    }
+    auto mode = std::find_if(std::begin(mode_names), std::end(mode_names), [&](char const* name){ return std::strcmp(name, argv[i]) == 0; });
+    if (mode == std::end(mode_names))
+    {
+      std::cerr << "Usage: " << argv[0] << " [--placement packed|spread|same-core|same-cluster|across-packages|all]... [--cpus LIST]... [direct|idle|eventcount]..." << std::endl;
+      return 1;
+    }
+    modes.push_back(static_cast<Mode>(mode - std::begin(mode_names)));
+  }
+  if (modes.empty())
+    modes = { direct, idle, eventcount };
+  if (placements.empty())
+    placements.emplace_back("unpinned", std::vector<int>{});
+
+  for (auto const& [placement, cpus] : placements)
+  {
+    std::cout << "Placement " << placement;
+    if (cpus.empty() && placement != "unpinned")
+    {
+      std::cout << ": not possible on this machine." << std::endl;
+      continue;
+    }
+    if (!cpus.empty())
+    {
+      std::cout << " (CPUs";
+      for (int cpu : cpus)
+        std::cout << ' ' << cpu;
+      std::cout << ')';
+    }
+    std::cout << ':' << std::endl;
+    // At least one producer and one consumer.
+    placement_cpus = cpus;
+    number_of_threads = std::max(2, cpus.empty() ? default_number_of_threads : static_cast<int>(cpus.size()));
+    for (Mode mode : modes)
+      run(mode);
+  }
 }
@@ -0,0 +1,101 @@
+#include "sys.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "AIBackoffReadWriteSpinLock.h"
+#include "AIWaitTimedReadWriteLock.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+// How long does a rare writer wait behind a continuous stream of readers (and vice versa)?
+//
+// Reader threads take the read lock back to back, holding it for reader_cs each time,
+// so that there is nearly always at least one reader inside. One writer thread takes
+// the write lock once every write_interval. Every lock is wrapped in AIWaitTimedReadWriteLock
+// which records the wait times.
+
+using namespace threadsafe;
+using clock_type = std::chrono::steady_clock;
+
+int const number_of_readers = std::max(3U, 2 * std::thread::hardware_concurrency() - 1);
+auto constexpr run_time = std::chrono::milliseconds(300);
+auto constexpr reader_cs = std::chrono::microseconds(2);
+auto constexpr writer_cs = std::chrono::microseconds(1);
+auto constexpr write_interval = std::chrono::milliseconds(1);
+
+void busy_for(clock_type::duration duration)
+{
+  auto const end = clock_type::now() + duration;
+  while (clock_type::now() < end)
+    ;
+}
+
+template<typename LOCK>
+void run(char const* name)
+{
+  AIWaitTimedReadWriteLock<LOCK> lock;
+  std::atomic<bool> stop{false};
+  long volatile data = 0;
+
+  std::vector<std::thread> thread_pool;
+  for (int r = 0; r < number_of_readers; ++r)
+    thread_pool.emplace_back([&]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      long sum = 0;
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        lock.rdlock();
+        sum += data;
+        busy_for(reader_cs);
+        lock.rdunlock();
+      }
+    });
+  thread_pool.emplace_back([&]{
+    Debug(NAMESPACE_DEBUG::init_thread());
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      lock.wrlock();
+      data = data + 1;
+      busy_for(writer_cs);
+      lock.wrunlock();
+      std::this_thread::sleep_for(write_interval);
+    }
+  });
+
+  std::this_thread::sleep_for(run_time);
+  stop = true;
+  for (auto& thread : thread_pool)
+    thread.join();
+
+  auto us = [](uint64_t ns){ return ns / 1000.0; };
+  std::cout << std::left << std::setw(58) << name << std::right << std::fixed << std::setprecision(1) <<
+    std::setw(8) << lock.writer_wait().count() <<
+    std::setw(12) << us(lock.writer_wait().percentile_ns(0.99)) << std::setw(12) << us(lock.writer_wait().max_ns()) <<
+    std::setw(12) << us(lock.reader_wait().percentile_ns(0.99)) << std::setw(12) << us(lock.reader_wait().max_ns()) << std::endl;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::cout << number_of_readers << " reader threads and one writer, during " << run_time.count() << " ms; wait times in microseconds.\n";
+  std::cout << std::left << std::setw(58) << "lock" << std::right << std::setw(8) << "writes" <<
+    std::setw(12) << "writer p99" << std::setw(12) << "writer max" << std::setw(12) << "reader p99" << std::setw(12) << "reader max" << std::endl;
+
+  run<AIReadWriteMutex>("AIReadWriteMutex");
+  run<AIReadWriteSpinLock>("AIReadWriteSpinLock");
+
+  using namespace threadsafe::fairness;
+  run<AIBackoffReadWriteSpinLock<backoff::SpinThenPark<>, ReaderPreferring>>("AIBackoffReadWriteSpinLock<SpinThenPark, ReaderPreferring>");
+  run<AIBackoffReadWriteSpinLock<backoff::SpinThenPark<>, WriterPreferring>>("AIBackoffReadWriteSpinLock<SpinThenPark, WriterPreferring>");
+  run<AIBackoffReadWriteSpinLock<backoff::SpinThenPark<>, PhaseFair>>("AIBackoffReadWriteSpinLock<SpinThenPark, PhaseFair>");
+  run<AIParkingReadWriteMutex<ReaderPreferring>>("AIParkingReadWriteMutex<ReaderPreferring>");
+  run<AIParkingReadWriteMutex<WriterPreferring>>("AIParkingReadWriteMutex<WriterPreferring>");
+  run<AIParkingReadWriteMutex<PhaseFair>>("AIParkingReadWriteMutex<PhaseFair>");
+}
@@ -0,0 +1,81 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "AIBackoffReadWriteSpinLock.h"
+#include "UnlockedLayout.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cassert>
+#include <algorithm>
+
+// False sharing between adjacent Unlocked objects.
+//
+// Every thread write locks and increments only its own element of an array of
+// Unlocked<long, POLICY> objects; there is no logical contention at all. With the
+// default (packed) layout several elements share a cache line, so every lock and
+// unlock still has to steal that line from the other threads. The CacheAligned
+// and Isolated layouts give every element its own cache line(s).
+
+using namespace threadsafe;
+
+int const number_of_threads = std::max(2U, std::thread::hardware_concurrency());
+int constexpr ops = 4000000;
+
+template<typename UNLOCKED>
+double run()
+{
+  std::vector<UNLOCKED> elements(number_of_threads);
+  std::atomic<bool> go{false};
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < number_of_threads; ++t)
+    thread_pool.emplace_back([&, t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      UNLOCKED& element = elements[t];
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      for (int i = 0; i < ops; ++i)
+      {
+        typename UNLOCKED::wat element_w(element);
+        ++*element_w;
+      }
+    });
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : thread_pool)
+    thread.join();
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  for (auto& element : elements)
+    assert(*typename UNLOCKED::crat(element) == ops);
+  return ns / ops;
+}
+
+template<typename POLICY>
+void compare(char const* name)
+{
+  using packed_type = Unlocked<long, POLICY>;
+  using cache_aligned_type = Unlocked<long, policy::CacheAligned<POLICY>>;
+  using isolated_type = Unlocked<long, policy::Isolated<POLICY>>;
+
+  std::cout << name << ":\n";
+  std::cout << "  " << std::left << std::setw(14) << "packed" << std::right << std::setw(4) << sizeof(packed_type) << " bytes: " <<
+    std::fixed << std::setprecision(1) << std::setw(6) << run<packed_type>() << " ns/op" << std::endl;
+  std::cout << "  " << std::left << std::setw(14) << "CacheAligned" << std::right << std::setw(4) << sizeof(cache_aligned_type) << " bytes: " <<
+    std::fixed << std::setprecision(1) << std::setw(6) << run<cache_aligned_type>() << " ns/op" << std::endl;
+  std::cout << "  " << std::left << std::setw(14) << "Isolated" << std::right << std::setw(4) << sizeof(isolated_type) << " bytes: " <<
+    std::fixed << std::setprecision(1) << std::setw(6) << run<isolated_type>() << " ns/op" << std::endl;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::cout << number_of_threads << " threads, each doing " << ops << " wat's on its own element." << std::endl;
+  compare<policy::Primitive<std::mutex>>("Primitive<std::mutex>");
+  compare<policy::ReadWrite<AIBackoffReadWriteSpinLock<>>>("ReadWrite<AIBackoffReadWriteSpinLock<>>");
+}
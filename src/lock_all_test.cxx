@@ -0,0 +1,172 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "LockAll.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Transfers between overlapping pairs of accounts, with lock_all versus one global mutex.
+//
+// Every transfer write locks two random accounts out of a small set (so that the
+// sets of concurrent transfers overlap) plus the fee account, which uses a different
+// policy (Primitive<std::mutex>) and is accessed through an UnlockedBase for half of
+// the accounts. Every tenth operation is an audit that read locks three accounts.
+// The total amount of money must be conserved.
+
+using namespace threadsafe;
+
+int const number_of_threads = std::max(4U, std::thread::hardware_concurrency());
+int constexpr number_of_accounts = 8;
+int constexpr ops = 200000;
+long constexpr initial_balance = 1000000;
+
+struct Account
+{
+  long balance = initial_balance;
+};
+
+struct Fees
+{
+  long collected = 0;
+};
+
+using unlocked_Account_t = Unlocked<Account, policy::ReadWrite<AIReadWriteMutex>>;
+using unlocked_Fees_t = Unlocked<Fees, policy::Primitive<std::mutex>>;
+using unlocked_Fees_base_t = UnlockedBase<Fees, policy::Primitive<std::mutex>>;
+
+unlocked_Account_t accounts[number_of_accounts];
+unlocked_Fees_t fees;
+unlocked_Fees_base_t fees_base(fees);
+std::mutex global_mutex;
+
+long volatile sink;
+
+struct Random
+{
+  unsigned int m_state;
+  unsigned int operator()(unsigned int n) { m_state = m_state * 1103515245 + 12345; return (m_state >> 8) % n; }
+};
+
+template<bool use_lock_all>
+void transfer(int from, int to, long amount, bool through_base)
+{
+  if constexpr (use_lock_all)
+  {
+    if (through_base)
+    {
+      auto [from_w, to_w, fees_w] = lock_all(write(accounts[from]), write(accounts[to]), write(fees_base));
+      from_w->balance -= amount + 1;
+      to_w->balance += amount;
+      fees_w->collected += 1;
+    }
+    else
+    {
+      auto [fees_w, to_w, from_w] = lock_all(write(fees), write(accounts[to]), write(accounts[from]));
+      from_w->balance -= amount + 1;
+      to_w->balance += amount;
+      fees_w->collected += 1;
+    }
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lk(global_mutex);
+    unlocked_Account_t::wat from_w(accounts[from]);
+    unlocked_Account_t::wat to_w(accounts[to]);
+    unlocked_Fees_t::wat fees_w(fees);
+    from_w->balance -= amount + 1;
+    to_w->balance += amount;
+    fees_w->collected += 1;
+  }
+}
+
+template<bool use_lock_all>
+void audit(int a, int b, int c)
+{
+  if constexpr (use_lock_all)
+  {
+    auto [a_r, b_r, c_r] = lock_all(read(accounts[a]), read(std::as_const(accounts[b])), read(accounts[c]));
+    sink = a_r->balance + b_r->balance + c_r->balance;
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lk(global_mutex);
+    unlocked_Account_t::crat a_r(accounts[a]);
+    unlocked_Account_t::crat b_r(accounts[b]);
+    unlocked_Account_t::crat c_r(accounts[c]);
+    sink = a_r->balance + b_r->balance + c_r->balance;
+  }
+}
+
+// Draw n different account numbers.
+void pick(Random& random, int* out, int n)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    bool duplicate;
+    do
+    {
+      out[i] = random(number_of_accounts);
+      duplicate = std::find(out, out + i, out[i]) != out + i;
+    }
+    while (duplicate);
+  }
+}
+
+template<bool use_lock_all>
+double run()
+{
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int t = 0; t < number_of_threads; ++t)
+    thread_pool.emplace_back([t]{
+      Debug(NAMESPACE_DEBUG::init_thread());
+      Random random{static_cast<unsigned int>(t + 1)};
+      int n[3];
+      for (int i = 0; i < ops; ++i)
+      {
+        if (i % 10 == 0)
+        {
+          pick(random, n, 3);
+          audit<use_lock_all>(n[0], n[1], n[2]);
+        }
+        else
+        {
+          pick(random, n, 2);
+          transfer<use_lock_all>(n[0], n[1], random(100), n[0] % 2 == 0);
+        }
+      }
+    });
+  for (auto& thread : thread_pool)
+    thread.join();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void check_conservation()
+{
+  long total = unlocked_Fees_t::crat(fees)->collected;
+  for (auto& account : accounts)
+    total += unlocked_Account_t::crat(account)->balance;
+  assert(total == number_of_accounts * initial_balance);
+  std::cout << "Money conserved: " << (total == number_of_accounts * initial_balance ? "yes" : "NO!") << std::endl;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  std::cout << number_of_threads << " threads, " << ops << " operations each, on " << number_of_accounts << " accounts." << std::endl;
+  double ms = run<true>();
+  std::cout << std::left << std::setw(16) << "lock_all:" << std::fixed << std::setprecision(1) << ms << " ms" << std::endl;
+  check_conservation();
+  ms = run<false>();
+  std::cout << std::left << std::setw(16) << "global mutex:" << std::fixed << std::setprecision(1) << ms << " ms" << std::endl;
+  check_conservation();
+}
@@ -0,0 +1,328 @@
+#include "sys.h"
+#include "threadsafe/threadsafe.h"
+#include "threadsafe/AIReadWriteMutex.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "AIShardedReadWriteLock.h"
+#include "debug.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include <stdexcept>
+
+// Lock workload generator.
+//
+// Runs the same parameterized workload against Unlocked<Payload, POLICY> for
+// every threadsafe policy and prints a throughput/latency table as CSV or JSON,
+// so that the choice of policy for a given object can be based on data.
+//
+// Usage: lock_workload_test [--write-ratio=0.01] [--cs-length=4] [--think=100|yield]
+//                           [--threads=1,2,4,...] [--objects=1] [--ops=1000000]
+//                           [--sample=16] [--format=text|csv|json]
+
+using namespace threadsafe;
+
+constexpr int max_cs_length = 64;
+
+// The protected data. The critical section touches the first cs_length words.
+struct Payload
+{
+  long words[max_cs_length];
+
+  Payload() : words{} { }
+};
+
+struct Workload
+{
+  double write_ratio = 0.01;            // Fraction of the operations that take write access.
+  int cs_length = 4;                    // Number of payload words read or written per access.
+  int think = 100;                      // Busy loop iterations between two accesses; -1 means std::this_thread::yield().
+  std::vector<int> thread_counts;       // Thread count sweep.
+  int objects = 1;                      // Number of independent Unlocked objects; each access picks one at random.
+  long ops = 1000000;                   // Number of accesses per thread.
+  int sample = 16;                      // Measure the latency of every sample-th access.
+};
+
+struct Result
+{
+  char const* policy;
+  int threads;
+  long total_ops;
+  double seconds;
+  double ops_per_sec;
+  double lat_p50_ns;
+  double lat_p90_ns;
+  double lat_p99_ns;
+  double lat_max_ns;
+};
+
+// Cheap per-thread pseudo random number generator (xorshift64*).
+class Random
+{
+  private:
+    uint64_t m_state;
+
+  public:
+    explicit Random(uint64_t seed) : m_state(seed * 0x9E3779B97F4A7C15ULL + 1) { }
+
+    uint64_t operator()()
+    {
+      m_state ^= m_state >> 12;
+      m_state ^= m_state << 25;
+      m_state ^= m_state >> 27;
+      return m_state * 0x2545F4914F6CDD1DULL;
+    }
+};
+
+long volatile sink;
+
+inline void think(int iterations)
+{
+  if (iterations < 0)
+  {
+    std::this_thread::yield();
+    return;
+  }
+  for (int i = 0; i < iterations; ++i)
+    std::atomic_signal_fence(std::memory_order_seq_cst);        // Stop the compiler from optimizing the loop away.
+}
+
+template<typename POLICY>
+Result run_workload(char const* policy_name, Workload const& workload, int number_of_threads)
+{
+  using unlocked_payload_t = Unlocked<Payload, POLICY>;
+  using clock_type = std::chrono::steady_clock;
+
+  std::unique_ptr<unlocked_payload_t[]> objects(new unlocked_payload_t[workload.objects]);
+  // 2^64 doesn't fit in a uint64_t, so a write ratio of 1 is handled separately.
+  bool const always_write = workload.write_ratio >= 1.0;
+  uint64_t const write_threshold = always_write ? 0 : static_cast<uint64_t>(workload.write_ratio * static_cast<double>(UINT64_MAX));
+
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::vector<double>> latencies(number_of_threads);
+  std::vector<long> writes(number_of_threads);
+  std::vector<std::thread> thread_pool;
+
+  auto worker = [&](int thr)
+  {
+    Debug(NAMESPACE_DEBUG::init_thread());
+    Random random(thr + 1);
+    std::vector<double>& samples(latencies[thr]);
+    samples.reserve(workload.ops / workload.sample + 1);
+    long number_of_writes = 0;
+
+    ++ready;
+    while (!go.load(std::memory_order_acquire))
+      ;
+
+    for (long i = 0; i < workload.ops; ++i)
+    {
+      unlocked_payload_t& object(objects[random() % workload.objects]);
+      bool const write = always_write || random() < write_threshold;
+      bool const sampled = i % workload.sample == 0;
+      clock_type::time_point start;
+      if (sampled)
+        start = clock_type::now();
+      if (write)
+      {
+        typename unlocked_payload_t::wat payload_w(object);
+        for (int k = 0; k < workload.cs_length; ++k)
+          ++payload_w->words[k];
+        ++number_of_writes;
+      }
+      else
+      {
+        typename unlocked_payload_t::crat payload_r(object);
+        long sum = 0;
+        for (int k = 0; k < workload.cs_length; ++k)
+          sum += payload_r->words[k];
+        sink = sum;
+      }
+      if (sampled)
+        samples.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+      think(workload.think);
+    }
+    writes[thr] = number_of_writes;
+  };
+
+  for (int thr = 0; thr < number_of_threads; ++thr)
+    thread_pool.emplace_back(worker, thr);
+  while (ready.load() != number_of_threads)
+    ;
+  auto start = clock_type::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : thread_pool)
+    thread.join();
+  double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  // Sanity check: every write incremented the first word of exactly one object.
+  long total_writes = 0;
+  for (long w : writes)
+    total_writes += w;
+  long counted = 0;
+  for (int i = 0; i < workload.objects; ++i)
+    counted += typename unlocked_payload_t::crat(objects[i])->words[0];
+  assert(workload.cs_length == 0 || counted == total_writes);
+
+  std::vector<double> all;
+  for (auto& samples : latencies)
+    all.insert(all.end(), samples.begin(), samples.end());
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double p) -> double {
+    if (all.empty())
+      return 0.0;
+    return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+  };
+
+  long total_ops = workload.ops * number_of_threads;
+  return { policy_name, number_of_threads, total_ops, seconds, total_ops / seconds,
+    percentile(0.50), percentile(0.90), percentile(0.99), all.empty() ? 0.0 : all.back() };
+}
+
+void print_csv(std::ostream& os, Workload const& workload, std::vector<Result> const& results)
+{
+  os << "policy,threads,objects,write_ratio,cs_length,think,total_ops,seconds,ops_per_sec,lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_max_ns\n";
+  for (Result const& r : results)
+    os << r.policy << ',' << r.threads << ',' << workload.objects << ',' << workload.write_ratio << ',' << workload.cs_length << ',' <<
+      workload.think << ',' << r.total_ops << ',' << r.seconds << ',' << r.ops_per_sec << ',' << r.lat_p50_ns << ',' <<
+      r.lat_p90_ns << ',' << r.lat_p99_ns << ',' << r.lat_max_ns << '\n';
+}
+
+void print_json(std::ostream& os, Workload const& workload, std::vector<Result> const& results)
+{
+  os << "{\n  \"workload\": { \"objects\": " << workload.objects << ", \"write_ratio\": " << workload.write_ratio <<
+    ", \"cs_length\": " << workload.cs_length << ", \"think\": " << workload.think << ", \"ops_per_thread\": " << workload.ops << " },\n";
+  os << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    Result const& r(results[i]);
+    os << "    { \"policy\": \"" << r.policy << "\", \"threads\": " << r.threads << ", \"total_ops\": " << r.total_ops <<
+      ", \"seconds\": " << r.seconds << ", \"ops_per_sec\": " << r.ops_per_sec <<
+      ", \"latency_ns\": { \"p50\": " << r.lat_p50_ns << ", \"p90\": " << r.lat_p90_ns << ", \"p99\": " << r.lat_p99_ns <<
+      ", \"max\": " << r.lat_max_ns << " } }" << (i + 1 < results.size() ? "," : "") << '\n';
+  }
+  os << "  ]\n}\n";
+}
+
+void print_text(std::ostream& os, std::vector<Result> const& results)
+{
+  os << std::left << std::setw(34) << "policy" << std::right << std::setw(8) << "threads" << std::setw(14) << "Mops/s" <<
+    std::setw(10) << "p50 ns" << std::setw(10) << "p90 ns" << std::setw(10) << "p99 ns" << std::setw(12) << "max ns" << '\n';
+  std::streamsize old_precision = os.precision(2);
+  os << std::fixed;
+  for (Result const& r : results)
+    os << std::left << std::setw(34) << r.policy << std::right << std::setw(8) << r.threads << std::setw(14) << r.ops_per_sec / 1e6 <<
+      std::setw(10) << r.lat_p50_ns << std::setw(10) << r.lat_p90_ns << std::setw(10) << r.lat_p99_ns << std::setw(12) << r.lat_max_ns << '\n';
+  os.precision(old_precision);
+  os.unsetf(std::ios_base::floatfield);
+}
+
+std::vector<int> parse_int_list(std::string const& list)
+{
+  std::vector<int> result;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, ','))
+    result.push_back(std::stoi(item));
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  Workload workload;
+  std::string format = "text";
+
+  auto usage = [argv]() {
+    std::cerr << "Usage: " << argv[0] << " [--write-ratio=0.01] [--cs-length=4] [--think=100|yield] [--threads=1,2,4] "
+      "[--objects=1] [--ops=1000000] [--sample=16] [--format=text|csv|json]" << std::endl;
+    return 1;
+  };
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+    try
+    {
+      if (key == "--write-ratio")
+      {
+        double const ratio = std::stod(value);
+        workload.write_ratio = ratio > 0.0 ? std::min(ratio, 1.0) : 0.0;
+      }
+      else if (key == "--cs-length")
+        workload.cs_length = std::clamp(std::stoi(value), 0, max_cs_length);
+      else if (key == "--think")
+        workload.think = value == "yield" ? -1 : std::stoi(value);
+      else if (key == "--threads")
+      {
+        workload.thread_counts = parse_int_list(value);
+        if (workload.thread_counts.empty() ||
+            std::any_of(workload.thread_counts.begin(), workload.thread_counts.end(), [](int n){ return n < 1; }))
+        {
+          std::cerr << argv[0] << ": " << key << " needs one or more thread counts of at least 1." << std::endl;
+          return usage();
+        }
+      }
+      else if (key == "--objects")
+        workload.objects = std::max(1, std::stoi(value));
+      else if (key == "--ops")
+        workload.ops = std::max(1L, std::stol(value));
+      else if (key == "--sample")
+        workload.sample = std::max(1, std::stoi(value));
+      else if (key == "--format" && (value == "text" || value == "csv" || value == "json"))
+        format = value;
+      else
+        return usage();
+    }
+    catch (std::invalid_argument const&)
+    {
+      std::cerr << argv[0] << ": " << key << ": \"" << value << "\" is not a number." << std::endl;
+      return usage();
+    }
+    catch (std::out_of_range const&)
+    {
+      std::cerr << argv[0] << ": " << key << ": " << value << " is out of range." << std::endl;
+      return usage();
+    }
+  }
+  if (workload.thread_counts.empty())
+  {
+    int const hardware_concurrency = std::max(1U, std::thread::hardware_concurrency());
+    for (int n = 1; n < hardware_concurrency; n *= 2)
+      workload.thread_counts.push_back(n);
+    workload.thread_counts.push_back(hardware_concurrency);
+  }
+
+  std::vector<Result> results;
+  for (int number_of_threads : workload.thread_counts)
+  {
+    // OneThread may only be accessed by a single thread.
+    if (number_of_threads == 1)
+      results.push_back(run_workload<policy::OneThread>("OneThread", workload, number_of_threads));
+    results.push_back(run_workload<policy::Primitive<std::mutex>>("Primitive<std::mutex>", workload, number_of_threads));
+    results.push_back(run_workload<policy::ReadWrite<AIReadWriteMutex>>("ReadWrite<AIReadWriteMutex>", workload, number_of_threads));
+    results.push_back(run_workload<policy::ReadWrite<AIReadWriteSpinLock>>("ReadWrite<AIReadWriteSpinLock>", workload, number_of_threads));
+    results.push_back(run_workload<policy::ShardedReadWrite>("ShardedReadWrite", workload, number_of_threads));
+  }
+
+  if (format == "csv")
+    print_csv(std::cout, workload, results);
+  else if (format == "json")
+    print_json(std::cout, workload, results);
+  else
+    print_text(std::cout, results);
+}
@@ -0,0 +1,153 @@
+#include "threadsafe/AIReadWriteMutex.h"
+#include "AIUpgradeableReadWriteMutex.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+
+// Compare the cost of converting a read lock into a write lock under contention:
+//
+// exception:   rd2wrlock() throws when it loses the race (the AIReadWriteMutex_test workload).
+// try:         try_rd2wrlock() returns false instead.
+// upgradeable: take the upgradeable read lock; ur2wrlock() never fails.
+
+constexpr unsigned int size_of_count = 33;
+long volatile count[size_of_count];
+int const number_of_threads = std::min(std::thread::hardware_concurrency(), size_of_count - 1);
+int const n = 100000;
+
+std::atomic<int> write_access;
+std::atomic<int> read_access;
+std::atomic<int> thr_count;
+
+inline void add(long d, int i = 0)
+{
+  ++write_access;
+  assert(write_access == 1 && read_access == 0);
+  count[0] = count[i] + d;
+  --write_access;
+}
+
+inline void read(int i)
+{
+  ++read_access;
+  assert(write_access == 0);
+  count[i] = count[0];
+  --read_access;
+}
+
+enum scheme_type { exception_scheme, try_scheme, upgradeable_scheme };
+
+char const* scheme_name(scheme_type scheme)
+{
+  switch (scheme)
+  {
+    case exception_scheme:
+      return "exception";
+    case try_scheme:
+      return "try";
+    case upgradeable_scheme:
+      return "upgradeable";
+  }
+  return "unknown";
+}
+
+template<typename MUTEX, scheme_type scheme>
+void run(MUTEX& m, std::atomic<double>& total_tries)
+{
+  int thr = ++thr_count;
+  double sum = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    m.wrlock();
+    add(1);
+    m.wrunlock();
+    for (int tries = 1;; ++tries)
+    {
+      std::this_thread::yield();
+      if constexpr (scheme == upgradeable_scheme)
+      {
+        m.urlock();
+        read(thr);
+        std::this_thread::yield();
+        m.ur2wrlock();
+        add(-1, thr);
+        m.wr2urlock();
+        m.urunlock();
+      }
+      else
+      {
+        m.rdlock();
+        read(thr);
+        std::this_thread::yield();
+        if constexpr (scheme == exception_scheme)
+        {
+          try
+          {
+            m.rd2wrlock();
+          }
+          catch (std::exception const&)
+          {
+            m.rdunlock();
+            m.rd2wryield();
+            continue;
+          }
+        }
+        else
+        {
+          if (!m.try_rd2wrlock())
+          {
+            m.rdunlock();
+            m.rd2wryield();
+            continue;
+          }
+        }
+        add(-1, thr);
+        m.wrunlock();
+      }
+      sum += tries;
+      break;
+    }
+  }
+  double expected = total_tries.load();
+  while (!total_tries.compare_exchange_weak(expected, expected + sum))
+    ;
+}
+
+template<typename MUTEX, scheme_type scheme>
+void bench(char const* mutex_name)
+{
+  MUTEX m;
+  std::atomic<double> total_tries{0.0};
+  thr_count = 0;
+  count[0] = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> thread_pool;
+  for (int i = 0; i < number_of_threads; ++i)
+    thread_pool.emplace_back([&]{ run<MUTEX, scheme>(m, total_tries); });
+  for (auto& thread : thread_pool)
+    thread.join();
+  auto end = std::chrono::steady_clock::now();
+
+  double const iterations = static_cast<double>(n) * number_of_threads;
+  double const ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+  std::cout << std::left << std::setw(28) << mutex_name << std::setw(12) << scheme_name(scheme) << std::right <<
+    std::fixed << std::setprecision(3) << std::setw(12) << (total_tries / iterations) << " tries/success" <<
+    std::setprecision(1) << std::setw(12) << ns_per_op << " ns/op" << "   count = " << count[0] << std::endl;
+  std::cout.unsetf(std::ios_base::floatfield);
+}
+
+int main()
+{
+  std::cout << "Running " << number_of_threads << " threads." << std::endl;
+  bench<AIReadWriteMutex, exception_scheme>("AIReadWriteMutex");
+  bench<AIUpgradeableReadWriteMutex, exception_scheme>("AIUpgradeableReadWriteMutex");
+  bench<AIUpgradeableReadWriteMutex, try_scheme>("AIUpgradeableReadWriteMutex");
+  bench<AIUpgradeableReadWriteMutex, upgradeable_scheme>("AIUpgradeableReadWriteMutex");
+}
@@ -2,6 +2,9 @@
 #include "threadsafe/ObjectTracker.h"
 #include "threadsafe/AIReadWriteMutex.h"
 #include "threadsafe/ObjectTracker.inl.h"
+#include "AIUpgradeableReadWriteMutex.h"
+#include "UpgradeableReadAccess.h"
+#include "UnlockedLayout.h"
 
 #include <iostream>
 #include <cassert>
@@ -19,6 +22,24 @@ void do_asserts()
   static_assert(alignof(Unlocked<typename U::data_type, policy::Primitive<std::mutex>>) % alignof(typename U::data_type) == 0, "alignof(Unlocked<T, Primitive<std::mutex>>) is not a multiple of alignof(T)!");
 }
 
+constexpr size_t round_up_to_cache_line(size_t size)
+{
+  return (size + cache_line_size - 1) / cache_line_size * cache_line_size;
+}
+
+template<typename T>
+void do_layout_asserts()
+{
+  using packed_type = Unlocked<T, policy::Primitive<std::mutex>>;
+  using cache_aligned_type = Unlocked<T, policy::CacheAligned<policy::Primitive<std::mutex>>>;
+  using isolated_type = Unlocked<T, policy::Isolated<policy::Primitive<std::mutex>>>;
+  static_assert(alignof(cache_aligned_type) == cache_line_size, "alignof(Unlocked<T, CacheAligned<P>>) != cache_line_size!");
+  static_assert(sizeof(cache_aligned_type) == round_up_to_cache_line(sizeof(packed_type)), "Unlocked<T, CacheAligned<P>> is not Unlocked<T, P> rounded up to whole cache lines!");
+  static_assert(alignof(isolated_type) == cache_line_size, "alignof(Unlocked<T, Isolated<P>>) != cache_line_size!");
+  static_assert(sizeof(std::mutex) > cache_line_size ||
+      sizeof(isolated_type) == cache_line_size + round_up_to_cache_line(sizeof(T)), "Unlocked<T, Isolated<P>> does not put T on its own cache line(s)!");
+}
+
 template<int size>
 void do_size_test()
 {
@@ -32,6 +53,10 @@ void do_size_test()
   do_asserts<size, Unlocked<T2, policy::OneThread>>();
   do_asserts<size, Unlocked<T4, policy::OneThread>>();
   do_asserts<size, Unlocked<T8, policy::OneThread>>();
+
+  do_layout_asserts<T0>();
+  do_layout_asserts<T1>();
+  do_layout_asserts<T8>();
 }
 
 enum state_type { unlocked, readlocked, writelocked };
@@ -671,6 +696,76 @@ int main()
     do_unlocked_test(const_unlockedbase_Foo_readwrite);
   }
 
+  // Upgradeable read access and non-throwing read to write conversion.
+  {
+    using unlocked_Doo_upgradeable_t = Unlocked<Doo, policy::ReadWrite<AIUpgradeableReadWriteMutex>>;
+    using unlockedbase_Foo_upgradeable_t = UnlockedBase<Foo, unlocked_Doo_upgradeable_t::policy_type>;
+
+    unlocked_Doo_upgradeable_t unlocked_Doo_upgradeable;
+    {
+      unlocked_Doo_upgradeable_t::wat doo_w(unlocked_Doo_upgradeable);
+      doo_w->x = 1;
+    }
+    {
+      UpgradeableReadAccess doo_u(unlocked_Doo_upgradeable);
+      {
+        // Ordinary readers coexist with the upgradeable reader.
+        unlocked_Doo_upgradeable_t::crat doo_r(unlocked_Doo_upgradeable);
+        assert(doo_r->x == 1);
+      }
+      UpgradedWriteAccess doo_w(doo_u);
+      doo_w->x = 2;
+    }
+    {
+      unlocked_Doo_upgradeable_t::rat doo_r(unlocked_Doo_upgradeable);
+      TryWriteAccess<unlocked_Doo_upgradeable_t> doo_w(doo_r);
+      assert(doo_w);                                            // Nobody else is converting.
+      doo_w->x = 3;
+    }
+    // The same through UnlockedBase (policy::ReadWriteRef).
+    unlockedbase_Foo_upgradeable_t unlockedbase_Foo_upgradeable(unlocked_Doo_upgradeable);
+    {
+      UpgradeableReadAccess foo_u(unlockedbase_Foo_upgradeable);
+      assert(foo_u->x == 3);
+      UpgradedWriteAccess foo_w(foo_u);
+      foo_w->x = 4;
+    }
+    {
+      unlockedbase_Foo_upgradeable_t::crat foo_r(unlockedbase_Foo_upgradeable);
+      assert(foo_r->x == 4);
+    }
+    std::cout << "Upgradeable access: Success!" << std::endl;
+  }
+
+  // Cache line layouts.
+  {
+    using unlocked_Foo_cache_aligned_t = Unlocked<Foo, policy::CacheAligned<policy::ReadWrite<TestRWMutex>>>;
+    using unlocked_Foo_isolated_t = Unlocked<Foo, policy::Isolated<policy::ReadWrite<TestRWMutex>>>;
+
+    unlocked_Foo_cache_aligned_t cache_aligned[2];
+    unlocked_Foo_isolated_t isolated;
+    assert(reinterpret_cast<uintptr_t>(&cache_aligned[1]) - reinterpret_cast<uintptr_t>(&cache_aligned[0]) == cache_line_size);
+    {
+      unlocked_Foo_isolated_t::wat foo_w(isolated);
+      // The data starts on the cache line after the one with the mutex.
+      assert(reinterpret_cast<char const*>(&*foo_w) - reinterpret_cast<char const*>(&isolated) == cache_line_size);
+      foo_w->x = 1;
+    }
+    {
+      unlocked_Foo_isolated_t::rat foo_r(isolated);
+      assert(foo_r->x == 1);
+      unlocked_Foo_isolated_t::wat foo_w(foo_r);
+      foo_w->x = 2;
+    }
+    {
+      unlocked_Foo_cache_aligned_t::wat foo_w(cache_aligned[1]);
+      foo_w->x = 3;
+    }
+    assert(unlocked_Foo_isolated_t::crat(isolated)->x == 2);
+    assert(unlocked_Foo_cache_aligned_t::crat(cache_aligned[1])->x == 3);
+    std::cout << "Cache line layouts: Success!" << std::endl;
+  }
+
   using unlocked_DooRF_onethread_t = Unlocked<DooRF, policy::OneThread>;
   using unlocked_DooRF_primitive_t = Unlocked<DooRF, policy::Primitive<TestMutex>>;
   using unlocked_DooRF_readwrite_t = Unlocked<DooRF, policy::ReadWrite<TestRWMutex>>;